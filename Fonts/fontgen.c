@@ -0,0 +1,214 @@
+//
+// Turns the pixel drawings in the font files into the tables in
+// ../Stroboman.X/fonts.c and fonts.h.
+//
+// The glyphs are stored page by page the way the LCD controller takes
+// them: all the columns of the top 8 pixel rows, then the next 8 and so
+// on, bit 0 at the top. One page of a glyph can then be sent as a single
+// run of bytes, and a page of a line of text as one run across all its
+// glyphs.
+//
+//   fontgen <output basename> <font file>...
+//
+// A font file starts with "font <name> <width> <height>" and has a glyph
+// for each "char <c>" line, <c> being the character itself, "space" or a
+// hex code optionally followed by a name for a FONT_<NAME> define. Then
+// come <height> lines of <width> pixels each, '#' for lit. Lines starting
+// with '#' in between glyphs are comments.
+//
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAXGLYPHS   256
+#define MAXWIDTH    32
+#define MAXHEIGHT   64
+
+typedef struct {
+    int code;
+    char name[32];
+    unsigned char bits[MAXHEIGHT/8][MAXWIDTH];
+} Glyph;
+
+typedef struct {
+    char name[32];
+    char file[256];
+    int width;
+    int height;
+    int count;
+    Glyph glyphs[MAXGLYPHS];
+} Font;
+
+static void Fail(const char *file, int line, const char *what) {
+    fprintf(stderr, "fontgen: %s:%d: %s\n", file, line, what);
+    exit(1);
+}
+
+static void Load(Font *f, const char *path) {
+    char line[256];
+    int n=0, row=-1;
+    Glyph *g=NULL;
+    FILE *in;
+
+    if (!(in=fopen(path, "r"))) {
+        perror(path);
+        exit(1);
+    }
+    memset(f, 0, sizeof(*f));
+    snprintf(f->file, sizeof(f->file), "%s", path);
+    while (fgets(line, sizeof(line), in)) {
+        n++;
+        line[strcspn(line, "\r\n")]=0;
+        if (row>=0) {
+            // Pixel rows of the current glyph
+            if ((int)strlen(line)!=f->width || strspn(line, "#.")!=strlen(line)) {
+                Fail(path, n, "pixel row has the wrong width or characters");
+            }
+            for (int x=0; x<f->width; x++) {
+                if (line[x]=='#') g->bits[row/8][x]|=1<<(row%8);
+            }
+            if (++row==f->height) row=-1;
+            continue;
+        }
+        if (!line[0] || line[0]=='#') continue;
+        if (!strncmp(line, "font ", 5)) {
+            if (sscanf(line+5, "%31s %d %d", f->name, &f->width, &f->height)!=3
+                    || f->width<1 || f->width>MAXWIDTH || f->height<1 || f->height>MAXHEIGHT) {
+                Fail(path, n, "expected font <name> <width> <height>");
+            }
+            continue;
+        }
+        if (!strncmp(line, "char ", 5)) {
+            const char *c=line+5;
+            if (!f->width) Fail(path, n, "char before font");
+            if (f->count==MAXGLYPHS) Fail(path, n, "too many glyphs");
+            g=&f->glyphs[f->count++];
+            if (!strcmp(c, "space")) {
+                g->code=' ';
+            } else if (!strncmp(c, "0x", 2)) {
+                char *end;
+                g->code=(int)strtol(c, &end, 16);
+                while (*end==' ') end++;
+                for (int i=0; end[i] && i<(int)sizeof(g->name)-1; i++) g->name[i]=toupper((unsigned char)end[i]);
+            } else if (strlen(c)==1) {
+                g->code=(unsigned char)c[0];
+            } else {
+                Fail(path, n, "expected char <c>, char space or char 0x<code> [name]");
+            }
+            if (g->code<' ' || g->code>0xFF) Fail(path, n, "character out of range");
+            for (int i=0; i<f->count-1; i++) {
+                if (f->glyphs[i].code==g->code) Fail(path, n, "character defined twice");
+            }
+            row=0;
+            continue;
+        }
+        Fail(path, n, "expected font, char or a comment");
+    }
+    if (row>=0) Fail(path, n, "file ends in the middle of a glyph");
+    fclose(in);
+
+    // Glyph 0 is what characters the font doesn't have come out as, so
+    // the space goes first
+    for (int i=0; i<f->count; i++) {
+        if (f->glyphs[i].code==' ') {
+            Glyph space=f->glyphs[i];
+            memmove(&f->glyphs[1], &f->glyphs[0], i*sizeof(Glyph));
+            f->glyphs[0]=space;
+            return;
+        }
+    }
+    Fail(path, n, "font has no space");
+}
+
+static void WriteFont(FILE *out, const Font *f) {
+    int pages=(f->height+7)/8;
+    int first=0xFF, last=0;
+
+    for (int i=0; i<f->count; i++) {
+        if (f->glyphs[i].code<first) first=f->glyphs[i].code;
+        if (f->glyphs[i].code>last) last=f->glyphs[i].code;
+    }
+
+    fprintf(out, "\n\n\n// %s, %dx%d from %s\n", f->name, f->width, f->height, f->file);
+    fprintf(out, "static const uint8_t %sGlyphs[]={\n", f->name);
+    for (int i=0; i<f->count; i++) {
+        const Glyph *g=&f->glyphs[i];
+        for (int p=0; p<pages; p++) {
+            fprintf(out, "    ");
+            for (int x=0; x<f->width; x++) fprintf(out, "0x%02X,", g->bits[p][x]);
+            if (p==0) {
+                // A backslash would carry the comment on to the next line
+                if (g->code==' ') fprintf(out, "   // space");
+                else if (g->code=='\\') fprintf(out, "   // backslash");
+                else if (g->name[0]) fprintf(out, "   // %s", g->name);
+                else fprintf(out, "   // %c", g->code);
+            }
+            fprintf(out, "\n");
+        }
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const uint8_t %sMap[]={", f->name);
+    for (int c=first; c<=last; c++) {
+        int glyph=0;
+        for (int i=0; i<f->count; i++) {
+            if (f->glyphs[i].code==c) glyph=i;
+        }
+        fprintf(out, "%s%3d,", (c-first)%16 ? " " : "\n    ", glyph);
+    }
+    fprintf(out, "\n};\n\n");
+    fprintf(out, "const t_font %s={%sGlyphs, %sMap, 0x%02X, %d, %d, %d};\n",
+        f->name, f->name, f->name, first, last-first+1, f->width, pages);
+}
+
+int main(int argc, char **argv) {
+    static Font fonts[8];
+    char path[256];
+    int n=argc-2;
+    FILE *out;
+
+    if (n<1 || n>(int)(sizeof(fonts)/sizeof(fonts[0]))) {
+        fprintf(stderr, "usage: fontgen <output basename> <font file>...\n");
+        return 1;
+    }
+    for (int i=0; i<n; i++) Load(&fonts[i], argv[i+2]);
+
+    snprintf(path, sizeof(path), "%s.h", argv[1]);
+    if (!(out=fopen(path, "w"))) {
+        perror(path);
+        return 1;
+    }
+    fprintf(out, "//\n// Fonts for the LCD, made by Fonts/fontgen, edit the font files there\n//\n\n");
+    fprintf(out, "#ifndef FONTS_H\n#define FONTS_H\n\n#include <stdint.h>\n\n");
+    fprintf(out, "typedef struct {\n");
+    fprintf(out, "    const uint8_t *glyphs;      // Page by page, width bytes each\n");
+    fprintf(out, "    const uint8_t *map;         // Glyph for each character from first on\n");
+    fprintf(out, "    uint8_t first;\n");
+    fprintf(out, "    uint8_t count;              // Characters in the map\n");
+    fprintf(out, "    uint8_t width;\n");
+    fprintf(out, "    uint8_t pages;\n");
+    fprintf(out, "} t_font;\n\n");
+    for (int i=0; i<n; i++) {
+        for (int k=0; k<fonts[i].count; k++) {
+            const Glyph *g=&fonts[i].glyphs[k];
+            if (g->name[0]) fprintf(out, "#define FONT_%-12s \"\\x%02X\"\n", g->name, g->code);
+        }
+    }
+    fprintf(out, "\n");
+    for (int i=0; i<n; i++) fprintf(out, "extern const t_font %s;\n", fonts[i].name);
+    fprintf(out, "\n#endif\n");
+    fclose(out);
+
+    snprintf(path, sizeof(path), "%s.c", argv[1]);
+    if (!(out=fopen(path, "w"))) {
+        perror(path);
+        return 1;
+    }
+    fprintf(out, "//\n// Fonts for the LCD, made by Fonts/fontgen, edit the font files there\n//\n\n");
+    fprintf(out, "#include <stdint.h>\n#include \"fonts.h\"\n");
+    for (int i=0; i<n; i++) WriteFont(out, &fonts[i]);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,32 @@
+//
+// Cycle cost model for code that doesn't touch any SFR.
+//
+// The simulator charges one instruction cycle per SFR access by itself,
+// everything else has to be charged explicitly by the firmware through
+// SIM_CYCLES(). These are approximate instruction cycle counts for the
+// XC8 runtime library on a PIC18 with the 8x8 hardware multiplier, they
+// only need to be good enough to compare two implementations.
+//
+
+#ifndef COST_H
+#define COST_H
+
+#define CY_CALL         4       // CALL + RETURN
+#define CY_POLL         3       // Test a flag and branch back
+#define CY_TBLRD        4       // Fetch one byte of a const table
+#define CY_ADD32        8       // 32 bit add/subtract/compare
+#define CY_SHIFT32      8       // 32 bit shift by one
+#define CY_MUL16        28      // 16x16->32 multiply
+#define CY_MUL32        70      // 32x32->32 multiply
+#define CY_UDIV8        90      // 8 bit divide or modulo
+#define CY_UDIV16       230     // 16 bit divide or modulo
+#define CY_UDIV32       620     // 32 bit divide or modulo
+#define CY_U32TOF       110     // uint32_t -> float
+#define CY_FTOU16       90      // float -> uint16_t
+#define CY_FMUL         330     // float multiply
+#define CY_FDIV         1150    // float divide
+
+#define CY_ISR_ENTRY    24      // Interrupt latency plus context save
+#define CY_ISR_EXIT     22      // Context restore plus RETFIE
+
+#endif
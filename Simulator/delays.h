@@ -0,0 +1,15 @@
+//
+// Host stand-in for the C18/XC8 <delays.h> busy-wait routines
+//
+
+#ifndef DELAYS_H
+#define DELAYS_H
+
+#include "sim.h"
+
+#define Delay10TCYx(n)  do { uint8_t _d=(n); do { SIM_CYCLES(10); } while (--_d); } while (0)
+#define Delay100TCYx(n) do { uint8_t _d=(n); do { SIM_CYCLES(100); } while (--_d); } while (0)
+#define Delay1KTCYx(n)  do { uint8_t _d=(n); do { SIM_CYCLES(1000); } while (--_d); } while (0)
+#define Delay10KTCYx(n) do { uint8_t _d=(n); do { SIM_CYCLES(10000); } while (--_d); } while (0)
+
+#endif
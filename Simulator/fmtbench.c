@@ -0,0 +1,118 @@
+//
+// Checks FormatUint16()/FormatUint32() against printf and reports what
+// formatting the RPM reading costs next to the divide and modulo per
+// digit it replaced.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "cost.h"
+#include "format.h"
+
+void ISR(void) {
+}
+
+// What main() used to do for the five RPM digits
+static void DigitsDivide(char *buf, uint16_t rpm) {
+    SIM_CYCLES(10*CY_UDIV16);
+    buf[0]='0'+(rpm/10000)%10;
+    buf[1]='0'+(rpm/1000)%10;
+    buf[2]='0'+(rpm/100)%10;
+    buf[3]='0'+(rpm/10)%10;
+    buf[4]='0'+(rpm/1)%10;
+    buf[5]=0;
+}
+
+static int failures;
+
+// The same with printf, blanks and the point put in by hand
+static void Expected(char *buf, uint32_t value, uint8_t type) {
+    int digits=type&0x0F, decimals=(type>>4)&3, units=digits-decimals-1, len=0;
+    int zeros;
+    char d[16];
+    uint64_t limit=1;
+
+    for (int i=0; i<digits; i++) limit*=10;
+    snprintf(d, sizeof(d), "%0*lu", digits, (unsigned long)value);
+    zeros=(int)strspn(d, "0");
+    for (int i=0; i<digits; i++) {
+        char c=d[i];
+        if (value>=limit) c='-';
+        else if ((type&FORMAT_BLANK) && i<units && i<zeros) c=' ';
+        buf[len++]=c;
+        if (decimals && i==units) buf[len++]='.';
+    }
+    buf[len]=0;
+}
+
+static void Check(uint32_t value, uint8_t type, int wide) {
+    char got[FORMAT_MAXLEN+4], want[FORMAT_MAXLEN+4];
+    uint8_t n;
+
+    memset(got, 'x', sizeof(got));
+    n=wide ? FormatUint32(got, value, type) : FormatUint16(got, (uint16_t)value, type);
+    Expected(want, value, type);
+    if (strcmp(got, want) || n!=strlen(want)) {
+        if (failures++<10) printf("MISMATCH %lu type=0x%02X got \"%s\" expected \"%s\"\n",
+            (unsigned long)value, type, got, want);
+    }
+}
+
+static void Bench(void) {
+    static const uint8_t types[]={
+        FORMAT_DIGITS(5), FORMAT_DIGITS(5)|FORMAT_BLANK, FORMAT_DIGITS(3),
+        FORMAT_DIGITS(4)|FORMAT_DECIMALS(1)|FORMAT_BLANK, FORMAT_DIGITS(6)|FORMAT_DECIMALS(3),
+        FORMAT_DIGITS(1), FORMAT_DIGITS(10)|FORMAT_BLANK,
+        FORMAT_DIGITS(10)|FORMAT_DECIMALS(2)|FORMAT_BLANK,
+    };
+    SimStat fast={0}, fast32={0}, slow={0};
+    char buf[FORMAT_MAXLEN];
+    uint32_t x=1;
+
+    // Every 16 bit value in each layout, and a spread of 32 bit ones
+    for (unsigned t=0; t<sizeof(types); t++) {
+        for (uint32_t v=0; v<0x10000; v++) {
+            Check(v, types[t], 0);
+            Check(v, types[t], 1);
+        }
+        for (int i=0; i<100000; i++) {
+            x=x*1664525UL+1013904223UL;
+            Check(x>>(i%32), types[t], 1);
+        }
+        Check(0xFFFFFFFFUL, types[t], 1);
+        Check(999999999UL, types[t], 1);
+        Check(1000000000UL, types[t], 1);
+    }
+
+    // Cost of the five RPM digits over the whole range
+    for (uint32_t v=0; v<0x10000; v+=7) {
+        uint64_t c0=sim_now();
+        FormatUint16(buf, (uint16_t)v, FORMAT_DIGITS(5));
+        uint64_t c1=sim_now();
+        DigitsDivide(buf, (uint16_t)v);
+        uint64_t c2=sim_now();
+        FormatUint32(buf, v<<8, FORMAT_DIGITS(8));
+        sim_stat_add(&fast, c1-c0);
+        sim_stat_add(&slow, c2-c1);
+        sim_stat_add(&fast32, sim_now()-c2);
+    }
+
+    printf("%-28s %s\n", "matches printf", failures ? "FAIL" : "ok");
+    printf("%-28s %8s %8s %8s\n", "cycles per number", "min", "avg", "max");
+    printf("%-28s %8llu %8.0f %8llu\n", "  FormatUint16, 5 digits",
+        (unsigned long long)fast.min, sim_stat_avg(&fast), (unsigned long long)fast.max);
+    printf("%-28s %8llu %8.0f %8llu\n", "  divide and modulo",
+        (unsigned long long)slow.min, sim_stat_avg(&slow), (unsigned long long)slow.max);
+    printf("%-28s %8llu %8.0f %8llu\n", "  FormatUint32, 8 digits",
+        (unsigned long long)fast32.min, sim_stat_avg(&fast32), (unsigned long long)fast32.max);
+    exit(failures ? 1 : 0);
+}
+
+int main(void) {
+    sim_init();
+    sim_run(Bench, 1e9);
+    return 0;
+}
@@ -0,0 +1,117 @@
+//
+// Checks RpmFromPeriod() against the float calculation it replaced and
+// reports what a conversion costs in instruction cycles. Checks the
+// ranged readings from RpmScaled() against exact division, and that each
+// keeps at least three significant digits from 2 RPM to a million RPM.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "cost.h"
+#include "rpm.h"
+#include "tach.h"
+
+void ISR(void) {
+}
+
+// The calculation main() used to do for every tach sample
+static uint16_t RpmFromPeriodFloat(uint32_t ticks) {
+    SIM_CYCLES(CY_U32TOF+2*CY_FDIV+CY_FTOU16);
+    return (uint16_t)(1000.0/(((float)ticks)/(12000.0*60.0)));
+}
+
+static int failures;
+
+static void Check(uint32_t ticks) {
+    uint32_t exact=RPM_CONSTANT/ticks;
+    uint16_t rpm=RpmFromPeriod(ticks);
+    if (exact>RPM_MAX) exact=RPM_MAX;
+    if (rpm!=exact) {
+        if (failures++<10) printf("MISMATCH ticks=%lu rpm=%u expected=%lu\n",
+            (unsigned long)ticks, rpm, (unsigned long)exact);
+    }
+}
+
+// A ranged reading for ticks, going there from range
+static uint8_t CheckScaled(uint32_t ticks, uint8_t range, SimStat *cost) {
+    uint64_t c0=sim_now(), exact;
+    uint16_t rpm=RpmFromPeriod(ticks), got;
+    static const uint64_t scale[RPM_KILO]={ 1000, 100, 10, 1 };
+
+    range=RpmRange(rpm, range);
+    got=RpmScaled(ticks, rpm, range);
+    sim_stat_add(cost, sim_now()-c0);
+    exact=range==RPM_KILO ? RPM_CONSTANT/(ticks*100ULL) : RPM_CONSTANT*scale[range]/ticks;
+    if (exact>0xFFFF) exact=0xFFFF;
+    if (got!=exact || got<600) {
+        if (failures++<10) printf("MISMATCH ticks=%lu range=%u reading=%u expected=%llu\n",
+            (unsigned long)ticks, range, got, (unsigned long long)exact);
+    }
+    return range;
+}
+
+static void Bench(void) {
+    SimStat fixed={0}, flt={0}, scaled={0};
+    uint8_t range=RPM_UNITS;
+    uint64_t floatDiffers=0;
+    uint32_t ticks;
+
+    // Every period the 24 bit tach counter can produce
+    for (ticks=1; ticks<(1UL<<24); ticks++) {
+        Check(ticks);
+        if (ticks>RPM_CONSTANT/(RPM_MAX+1UL) && RpmFromPeriodFloat(ticks)!=RpmFromPeriod(ticks)) {
+            floatDiffers++;
+        }
+    }
+
+    // Above that the result only changes at RPM_CONSTANT/n, check both
+    // sides of every step plus the extremes
+    for (uint32_t q=1; q<=RPM_CONSTANT/(1UL<<24)+1; q++) {
+        ticks=RPM_CONSTANT/q;
+        Check(ticks-1);
+        Check(ticks);
+        Check(ticks+1);
+    }
+    Check(RPM_CONSTANT+1);
+    Check(0xFFFFFFFFUL);
+
+    // Cost over a log sweep of periods from 100k RPM down to 1 RPM
+    for (double t=RPM_CONSTANT/100000.0; t<=RPM_CONSTANT; t*=1.001) {
+        uint64_t c0=sim_now();
+        RpmFromPeriod((uint32_t)t);
+        uint64_t c1=sim_now();
+        RpmFromPeriodFloat((uint32_t)t);
+        sim_stat_add(&fixed, c1-c0);
+        sim_stat_add(&flt, sim_now()-c1);
+    }
+
+    // Ranged readings from a million RPM down to the slowest measured,
+    // and back up again
+    for (double t=RPM_CONSTANT/1000000.0; t<=TACH_MAXPERIOD; t*=1.0001) {
+        range=CheckScaled((uint32_t)t, range, &scaled);
+    }
+    for (double t=TACH_MAXPERIOD; t>=RPM_CONSTANT/1000000.0; t/=1.0001) {
+        range=CheckScaled((uint32_t)t, range, &scaled);
+    }
+
+    printf("%-28s %s\n", "exact over full range", failures ? "FAIL" : "ok");
+    printf("%-28s %llu periods, float rounded one low there\n", "differs from float path",
+        (unsigned long long)floatDiffers);
+    printf("%-28s %8s %8s %8s\n", "cycles per conversion", "min", "avg", "max");
+    printf("%-28s %8llu %8.0f %8llu\n", "  reciprocal",
+        (unsigned long long)fixed.min, sim_stat_avg(&fixed), (unsigned long long)fixed.max);
+    printf("%-28s %8llu %8.0f %8llu\n", "  float",
+        (unsigned long long)flt.min, sim_stat_avg(&flt), (unsigned long long)flt.max);
+    printf("%-28s %8llu %8.0f %8llu\n", "  ranged, with the above",
+        (unsigned long long)scaled.min, sim_stat_avg(&scaled), (unsigned long long)scaled.max);
+    exit(failures ? 1 : 0);
+}
+
+int main(void) {
+    sim_init();
+    sim_run(Bench, 1e9);
+    return 0;
+}
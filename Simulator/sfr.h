@@ -0,0 +1,102 @@
+//
+// PIC18F14K50 SFR addresses and bit layouts shared by the fake <xc.h>
+// and the simulator core
+//
+
+#ifndef SFR_H
+#define SFR_H
+
+#include <stdint.h>
+
+// SFR addresses, the simulator only keeps the low byte (0xF00-0xFFF)
+#define SFR_UEP0        0x53
+#define SFR_UEP1        0x54
+#define SFR_UEP2        0x55
+#define SFR_UADDR       0x5C
+#define SFR_UFRML       0x5D
+#define SFR_UFRMH       0x5E
+#define SFR_UIE         0x60
+#define SFR_UCFG        0x61
+#define SFR_UIR         0x62
+#define SFR_USTAT       0x63
+#define SFR_UCON        0x64
+#define SFR_WPUB        0x78
+#define SFR_IOCB        0x7A
+#define SFR_ANSEL       0x7E
+#define SFR_ANSELH      0x7F
+#define SFR_PORTA       0x80
+#define SFR_PORTB       0x81
+#define SFR_PORTC       0x82
+#define SFR_LATA        0x89
+#define SFR_LATB        0x8A
+#define SFR_LATC        0x8B
+#define SFR_TRISA       0x92
+#define SFR_TRISB       0x93
+#define SFR_TRISC       0x94
+#define SFR_PIE1        0x9D
+#define SFR_PIR1        0x9E
+#define SFR_IPR1        0x9F
+#define SFR_PIE2        0xA0
+#define SFR_PIR2        0xA1
+#define SFR_IPR2        0xA2
+#define SFR_EECON1      0xA6
+#define SFR_EECON2      0xA7
+#define SFR_EEDATA      0xA8
+#define SFR_EEADR       0xA9
+#define SFR_T3CON       0xB1
+#define SFR_TMR3L       0xB2
+#define SFR_TMR3H       0xB3
+#define SFR_SSPCON1     0xC6
+#define SFR_SSPSTAT     0xC7
+#define SFR_SSPBUF      0xC9
+#define SFR_T2CON       0xCA
+#define SFR_PR2         0xCB
+#define SFR_TMR2        0xCC
+#define SFR_T1CON       0xCD
+#define SFR_TMR1L       0xCE
+#define SFR_TMR1H       0xCF
+#define SFR_RCON        0xD0
+#define SFR_OSCCON      0xD3
+#define SFR_T0CON       0xD5
+#define SFR_TMR0L       0xD6
+#define SFR_TMR0H       0xD7
+#define SFR_INTCON3     0xF0
+#define SFR_INTCON2     0xF1
+#define SFR_INTCON      0xF2
+
+typedef struct { uint8_t :1, SUSPND:1, RESUME:1, USBEN:1, PKTDIS:1, SE0:1, PPBRST:1, :1; } UCONbits_t;
+typedef struct { uint8_t PPB0:1, PPB1:1, FSEN:1, UTRDIS:1, UPUEN:1, :1, UOEMON:1, UTEYE:1; } UCFGbits_t;
+typedef struct { uint8_t :1, PPBI:1, DIR:1, ENDP:4, :1; } USTATbits_t;
+typedef struct { uint8_t URSTIF:1, UERRIF:1, ACTVIF:1, TRNIF:1, IDLEIF:1, STALLIF:1, SOFIF:1, :1; } UIRbits_t;
+typedef struct { uint8_t RA0:1, RA1:1, RA2:1, RA3:1, RA4:1, RA5:1, :2; } PORTAbits_t;
+typedef struct { uint8_t :4, RB4:1, RB5:1, RB6:1, RB7:1; } PORTBbits_t;
+typedef struct { uint8_t RC0:1, RC1:1, RC2:1, RC3:1, RC4:1, RC5:1, RC6:1, RC7:1; } PORTCbits_t;
+typedef struct { uint8_t :4, LATB4:1, LATB5:1, LATB6:1, LATB7:1; } LATBbits_t;
+typedef struct { uint8_t LATC0:1, LATC1:1, LATC2:1, LATC3:1, LATC4:1, LATC5:1, LATC6:1, LATC7:1; } LATCbits_t;
+typedef struct { uint8_t :4, TRISB4:1, TRISB5:1, TRISB6:1, TRISB7:1; } TRISBbits_t;
+typedef struct { uint8_t TRISC0:1, TRISC1:1, TRISC2:1, TRISC3:1, TRISC4:1, TRISC5:1, TRISC6:1, TRISC7:1; } TRISCbits_t;
+typedef struct { uint8_t TMR1IF:1, TMR2IF:1, CCP1IF:1, SSPIF:1, TXIF:1, RCIF:1, ADIF:1, :1; } PIR1bits_t;
+typedef struct { uint8_t TMR1IE:1, TMR2IE:1, CCP1IE:1, SSPIE:1, TXIE:1, RCIE:1, ADIE:1, :1; } PIE1bits_t;
+typedef struct { uint8_t TMR1IP:1, TMR2IP:1, CCP1IP:1, SSPIP:1, TXIP:1, RCIP:1, ADIP:1, :1; } IPR1bits_t;
+typedef struct { uint8_t :1, TMR3IF:1, USBIF:1, BCLIF:1, EEIF:1, C2IF:1, C1IF:1, OSCFIF:1; } PIR2bits_t;
+typedef struct { uint8_t :1, TMR3IE:1, USBIE:1, BCLIE:1, EEIE:1, C2IE:1, C1IE:1, OSCFIE:1; } PIE2bits_t;
+typedef struct { uint8_t :1, TMR3IP:1, USBIP:1, BCLIP:1, EEIP:1, C2IP:1, C1IP:1, OSCFIP:1; } IPR2bits_t;
+typedef struct { uint8_t RD:1, WR:1, WREN:1, WRERR:1, FREE:1, :1, CFGS:1, EEPGD:1; } EECON1bits_t;
+typedef struct { uint8_t TMR3ON:1, TMR3CS:1, nT3SYNC:1, T3CCP1:1, T3CKPS:2, :1, RD16:1; } T3CONbits_t;
+typedef struct { uint8_t SSPM:4, CKP:1, SSPEN:1, SSPOV:1, WCOL:1; } SSPCON1bits_t;
+typedef struct { uint8_t BF:1, UA:1, R_nW:1, S:1, P:1, D_nA:1, CKE:1, SMP:1; } SSPSTATbits_t;
+typedef struct { uint8_t T2CKPS:2, TMR2ON:1, T2OUTPS:4, :1; } T2CONbits_t;
+typedef struct { uint8_t TMR1ON:1, TMR1CS:1, nT1SYNC:1, T1OSCEN:1, T1CKPS:2, T1RUN:1, RD16:1; } T1CONbits_t;
+typedef struct { uint8_t SCS:2, HFIOFS:1, OSTS:1, IRCF:3, IDLEN:1; } OSCCONbits_t;
+typedef struct { uint8_t nBOR:1, nPOR:1, nPD:1, nTO:1, nRI:1, :1, SBOREN:1, IPEN:1; } RCONbits_t;
+typedef struct { uint8_t T0PS:3, PSA:1, T0SE:1, T0CS:1, T08BIT:1, TMR0ON:1; } T0CONbits_t;
+typedef struct { uint8_t INT1IF:1, INT2IF:1, :1, INT1IE:1, INT2IE:1, :1, INT1IP:1, INT2IP:1; } INTCON3bits_t;
+typedef struct { uint8_t RABIP:1, :1, TMR0IP:1, :1, INTEDG2:1, INTEDG1:1, INTEDG0:1, nRABPU:1; } INTCON2bits_t;
+typedef struct { uint8_t RABIF:1, INT0IF:1, TMR0IF:1, RABIE:1, INT0IE:1, TMR0IE:1, PEIE:1, GIE:1; } INTCONbits_t;
+
+
+// Multi-bit fields split into single bits
+typedef struct { uint8_t :4, B0:1, B1:1, :2; } SIM_T1CKPSbits_t;
+typedef struct { uint8_t B0:1, B1:1, :6; } SIM_T2CKPSbits_t;
+
+#endif
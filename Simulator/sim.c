@@ -0,0 +1,1420 @@
+//
+// Cycle counting host simulator for the Stroboman firmware
+//
+// Time only moves when the firmware touches an SFR or charges cycles with
+// SIM_CYCLES(). At each of those points the simulator first commits any
+// register write done since the previous access, then advances the
+// peripherals event by event, entering ISR() at the exact cycle an enabled
+// interrupt becomes pending, and finally publishes the current timer values
+// back into the register file. SLEEP skips ahead to the event that wakes
+// the chip up, with the timers stopped when it's the oscillator that is.
+//
+
+#include <ctype.h>
+#include <math.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sfr.h"
+#include "cost.h"
+#include "sim.h"
+#include "rpm.h"
+
+#define REG(t,a)        (*(volatile t *)&sfr[a])
+#define NEVER           UINT64_MAX
+#define MAXSEGMENTS     256
+#define EDGEHISTORY     64      // Power of two
+#define MAXPULSES       32      // Tach pulses scheduled ahead, edges and their bounces
+#define MAXBOUNCES      8
+#define SETTLED         0.005   // A reading within this of the RPM has settled
+#define MINRPM          2.0     // The slowest the display reads
+#define MAXPINCHANGES   8192
+#define BOUNCE          0.00015 // Seconds between the bounces of a contact
+#define USB_STEP        (SIM_FCY/8000)  // The host tries a transaction every 125us
+#define USB_RESET       (SIM_FCY/100)   // Bus reset, 10ms
+#define USB_IDLE        (SIM_FCY/1000*3) // Without a SOF the SIE takes the bus for suspended
+
+extern void ISR(void);
+
+SimStats simStats;
+uint8_t simLcd[SIM_LCD_PAGES][SIM_LCD_COLS];
+uint8_t simLcdOn;
+uint8_t simEeprom[SIM_EEPROM_SIZE];
+static uint32_t eeWear[SIM_EEPROM_SIZE];
+volatile uint8_t simUsbRam[256];
+
+static volatile uint8_t sfr[256];
+
+typedef struct {
+    double jitter;          // Seconds an edge may be early or late by
+    int dropout;            // Every so many edges is missing, 0 for none
+    int bounces;            // Extra edges after each one
+    double bounceGap;       // Seconds between them
+} Noise;
+
+typedef struct {
+    double start;
+    double length;
+    double rpmFrom;
+    double rpmTo;
+    Noise noise;
+} Segment;
+
+typedef struct {
+    uint64_t at;
+    uint64_t edge;          // Number of the edge it belongs to
+    uint8_t bounce;
+} Pulse;
+
+// What the chip is doing, the timers only run when the CPU does or idles
+enum { PW_RUN, PW_IDLE, PW_SLEEP, PW_WAKE };
+
+static struct {
+    uint64_t cycle;
+    uint64_t end;
+    uint8_t inIsr;
+    uint8_t power;
+    jmp_buf exit;
+
+    uint16_t tmr0;
+    uint16_t pre0;
+    uint64_t tmr0Ticks;     // Total count, the low 32 bits are the firmware's timebase
+    uint8_t pubTmr0l;
+    uint8_t tmr0hBuf;       // TMR0H as written, before a TMR0L access latched it
+
+    uint16_t tmr1;
+    uint16_t pre1;
+    uint8_t pubTmr1l;
+    uint8_t pubTmr1h;
+
+    uint8_t tmr2;
+    uint8_t pre2;
+    uint8_t post2;
+    uint8_t pubTmr2;
+    uint8_t pubT2con;
+
+    uint16_t tmr3;
+    uint16_t pre3;
+    uint8_t pubTmr3l;
+    uint8_t pubTmr3h;
+
+    uint8_t sspWrite;
+    uint8_t sspBusy;
+    uint8_t sspData;
+    uint64_t sspDone;
+
+    uint8_t eeUnlock;       // Steps of the 0x55, 0xAA unlock sequence seen
+    uint8_t eeBusy;
+    uint8_t eeAddr;
+    uint8_t eeData;
+    uint64_t eeDone;
+
+    uint8_t latb;
+    uint8_t latc;
+    uint64_t ledOnAt;
+    uint8_t ledFlash;       // LED went on in the ISR, not the power-on blink
+
+    uint16_t lcdShift;      // 9 bit words are shifted in a bit at a time
+    uint8_t lcdBits;
+    uint8_t lcdPage;
+    uint8_t lcdCol;
+
+    uint64_t nextEdge;
+    uint64_t lastEdge;
+    uint64_t lastPulse;     // The last edge as the sensor gave it, bounces aside
+    uint64_t loopAt;            // Start of the current main loop pass
+    uint64_t loopMain;          // simStats.mainCycles then
+    uint64_t loopStopped;       // and the cycles idle or asleep
+    uint64_t loopWork;          // Samples, frames and SPI bytes so far then
+    uint64_t int1EdgeAt;
+    uint64_t int1Edge;      // Number of the edge that set INT1IF
+    uint64_t revEdge;       // Number of an edge the firmware starts a revolution on
+    double angle;           // Expected flash angle, negative when not checked
+    int flashes;
+    uint64_t flashAt;
+    uint8_t flashPending;
+    double freeHz;          // Expected free running flash rate, 0 when not checked
+    uint64_t freeK;         // Flash number of the last free running flash
+    uint64_t edgeAt[EDGEHISTORY];
+    Pulse pulse[MAXPULSES];     // On INT1, in order of time
+    int pulses;
+    uint32_t random;
+    int readingSegment;     // Segment of the last reading shown, -1 before the first
+    uint8_t inTolerance;    // It was within SETTLED
+    uint64_t settledAt;     // since then
+} s;
+
+typedef struct {
+    uint64_t at;
+    uint8_t port;           // 0 for port B, 1 for port C
+    uint8_t mask;
+    uint8_t level;
+} PinChange;
+
+static struct {
+    PinChange change[MAXPINCHANGES];
+    int changes;
+    int next;
+    uint8_t pins[2];        // Input levels of ports B and C
+} panel;
+
+enum { UH_DETACHED, UH_RESET, UH_ENUMERATE, UH_STREAM };
+enum { US_SETUP, US_IN, US_OUT, US_STATUS_IN, US_STATUS_OUT };
+
+static struct {
+    uint8_t host;           // There's a host, with the cable in from plugAt to unplugAt
+    uint64_t plugAt;
+    uint64_t unplugAt;
+    uint8_t state;
+    uint64_t next;          // Next host step
+    uint64_t activeAt;      // Last step with the cable in
+    uint8_t idle;           // IDLEIF has been raised since
+    uint64_t resetEnd;
+    uint16_t frame;
+    uint8_t steps;          // Host steps into the frame
+    uint8_t addr;           // Address the host talks to
+    uint8_t req;            // Request of the enumeration it's on
+    uint8_t stage;
+    uint8_t toggle;         // DATA1 expected next on endpoint 0
+    uint8_t bulkToggle;     // and on bulk IN
+    uint16_t sent;          // Data stage bytes so far
+    uint8_t reply[256];
+    uint16_t configLength;
+    uint8_t fifo[3];        // Transactions waiting behind the one in USTAT
+    uint8_t fifoN;
+    uint8_t *stream;        // Everything from bulk IN
+    size_t streamSize;
+} usb;
+
+static struct {
+    Segment seg[MAXSEGMENTS];
+    int segments;
+    double length;
+    uint8_t edgesPerRev;
+} prof;
+
+
+
+//
+// Statistics helpers
+//
+void sim_stat_add(SimStat *st, uint64_t v) {
+    if (st->n==0 || v<st->min) st->min=v;
+    if (v>st->max) st->max=v;
+    st->sum+=v;
+    st->n++;
+}
+
+double sim_stat_avg(const SimStat *st) {
+    return st->n ? (double)st->sum/st->n : 0.0;
+}
+
+double sim_us(double cycles) {
+    return cycles*1e6/SIM_FCY;
+}
+
+uint64_t sim_now(void) {
+    return s.cycle;
+}
+
+
+
+//
+// RPM profile, a list of linear ramps. Each line of the file holds the
+// segment length in ms followed by the RPM at its start and (optionally)
+// at its end. Past the last segment the final RPM is held.
+//
+// The tach signal can be made worse for the segments that follow with
+//
+//   jitter <us>            each edge early or late by up to that much
+//   dropout <n>            every nth edge is missing, 0 for none
+//   bounce <n> <us>        each edge is followed by n more that far apart
+//
+static int Directive(const char *line, Noise *noise) {
+    char word[16];
+    double us;
+    int n;
+
+    if (sscanf(line, "%15s", word)!=1) return -1;
+    if (!strcmp(word, "jitter") && sscanf(line, "%*s %lf", &us)==1 && us>=0) {
+        noise->jitter=us/1e6;
+    } else if (!strcmp(word, "dropout") && sscanf(line, "%*s %d", &n)==1 && n>=0 && n!=1) {
+        noise->dropout=n;
+    } else if (!strcmp(word, "bounce") && sscanf(line, "%*s %d %lf", &n, &us)==2
+            && n>=0 && n<=MAXBOUNCES && us>0) {
+        noise->bounces=n;
+        noise->bounceGap=us/1e6;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int sim_load_profile(const char *path, uint8_t edgesPerRev) {
+    char line[256];
+    Noise noise={0};
+    FILE *f=fopen(path, "r");
+    if (!f) return -1;
+    prof.segments=0;
+    prof.length=0;
+    prof.edgesPerRev=edgesPerRev;
+    while (fgets(line, sizeof(line), f)) {
+        double ms, from, to;
+        char *p=strchr(line, '#');
+        if (p) *p=0;
+        for (p=line; isspace((unsigned char)*p); p++);
+        if (isalpha((unsigned char)*p)) {
+            if (Directive(p, &noise)) {
+                fclose(f);
+                return -1;
+            }
+            continue;
+        }
+        int n=sscanf(line, "%lf %lf %lf", &ms, &from, &to);
+        if (n<=0) continue;
+        if (n<2 || prof.segments>=MAXSEGMENTS) {
+            fclose(f);
+            return -1;
+        }
+        if (n==2) to=from;
+        Segment *g=&prof.seg[prof.segments++];
+        g->start=prof.length;
+        g->length=ms/1000.0;
+        g->rpmFrom=from;
+        g->rpmTo=to;
+        g->noise=noise;
+        prof.length+=g->length;
+    }
+    fclose(f);
+    return prof.segments ? 0 : -1;
+}
+
+double sim_profile_seconds(void) {
+    return prof.length;
+}
+
+// The segment at a time, past the end the last one
+static int SegmentAt(double t) {
+    int i;
+    for (i=0; i<prof.segments-1 && t>=prof.seg[i].start+prof.seg[i].length; i++);
+    return i;
+}
+
+double sim_rpm_at(double t) {
+    for (int i=0; i<prof.segments; i++) {
+        Segment *g=&prof.seg[i];
+        if (t<g->start+g->length) {
+            return g->rpmFrom+(g->rpmTo-g->rpmFrom)*(t-g->start)/g->length;
+        }
+    }
+    return prof.segments ? prof.seg[prof.segments-1].rpmTo : 0.0;
+}
+
+static uint64_t NextEdge(uint64_t from) {
+    double t=(double)from/SIM_FCY;
+    for (;;) {
+        double rpm=sim_rpm_at(t);
+        if (rpm>=1.0) {
+            // Use the speed half way through the interval so ramps don't lag
+            double dt=60.0/(rpm*prof.edgesPerRev);
+            rpm=sim_rpm_at(t+dt/2);
+            if (rpm<1.0) rpm=1.0;
+            return (uint64_t)llround(t*SIM_FCY+60.0*SIM_FCY/(rpm*prof.edgesPerRev));
+        }
+        if (t>=prof.length) return NEVER;
+        t+=0.001;
+    }
+}
+
+
+
+//
+// LCD controller, 9 bit SPI where the first bit selects command or data.
+// The bits may come from the hand clocked D/C bit or from the MSSP in any
+// mix, only taking the chip select high starts a new word.
+//
+static void LcdByte(uint8_t dc, uint8_t b) {
+    if (dc) {
+        if (s.lcdPage<SIM_LCD_PAGES && s.lcdCol<SIM_LCD_COLS) simLcd[s.lcdPage][s.lcdCol]=b;
+        if (++s.lcdCol>=SIM_LCD_COLS) {
+            s.lcdCol=0;
+            s.lcdPage++;
+            if (s.lcdPage>=SIM_LCD_PAGES) s.lcdPage=0;
+        }
+        return;
+    }
+    if (b==0xAE || b==0xAF) simLcdOn=b&1;
+    else if ((b&0xF0)==0xB0) s.lcdPage=b&0x0F;
+    else if ((b&0xF8)==0x10) s.lcdCol=(s.lcdCol&0x0F)|((b&0x07)<<4);
+    else if ((b&0xF0)==0x00) s.lcdCol=(s.lcdCol&0x70)|(b&0x0F);
+}
+
+static void LcdBits(uint8_t v, int n) {
+    while (n--) {
+        s.lcdShift=(uint16_t)(s.lcdShift<<1)|((v>>n)&1);
+        if (++s.lcdBits==9) {
+            LcdByte((s.lcdShift>>8)&1, (uint8_t)s.lcdShift);
+            s.lcdShift=0;
+            s.lcdBits=0;
+        }
+    }
+}
+
+
+
+//
+// Knob and buttons. Every contact closes to ground and is pulled up when
+// open, and bounces a few times each way. The firmware polls them, and a
+// change of a port B pin with its IOCB bit set raises RABIF, which is
+// how a button wakes the chip up from sleep.
+//
+static const struct {
+    uint8_t port;
+    uint8_t mask;
+} buttons[]={
+    { 0, 0x10 },    // UP on RB4
+    { 0, 0x20 },    // OK on RB5
+    { 0, 0x80 },    // DOWN on RB7
+    { 1, 0x20 },    // Encoder switch on RC5
+};
+
+#define ENC_A   0x08    // RC3
+#define ENC_B   0x10    // RC4
+
+static int PinAt(double t, uint8_t port, uint8_t mask, int level) {
+    int i;
+    if (panel.changes>=MAXPINCHANGES) return -1;
+    // Keep them in order of time
+    for (i=panel.changes; i>panel.next && panel.change[i-1].at>(uint64_t)(t*SIM_FCY); i--) {
+        panel.change[i]=panel.change[i-1];
+    }
+    panel.change[i].at=(uint64_t)(t*SIM_FCY);
+    panel.change[i].port=port;
+    panel.change[i].mask=mask;
+    panel.change[i].level=(uint8_t)level;
+    panel.changes++;
+    return 0;
+}
+
+// A contact closing or opening with three bounces
+static int Contact(double t, uint8_t port, uint8_t mask, int level) {
+    int err=0;
+    for (int i=0; i<3; i++) {
+        err|=PinAt(t+2*i*BOUNCE, port, mask, level);
+        err|=PinAt(t+(2*i+1)*BOUNCE, port, mask, !level);
+    }
+    return err|PinAt(t+6*BOUNCE, port, mask, level);
+}
+
+static void PinChanges(void) {
+    while (panel.next<panel.changes && panel.change[panel.next].at<=s.cycle) {
+        PinChange *c=&panel.change[panel.next++];
+        uint8_t was=panel.pins[c->port];
+        if (c->level) panel.pins[c->port]|=c->mask;
+        else panel.pins[c->port]&=~c->mask;
+        if (!c->port && (was^panel.pins[0])&sfr[SFR_IOCB]&sfr[SFR_TRISB]) {
+            REG(INTCONbits_t, SFR_INTCON).RABIF=1;
+        }
+    }
+}
+
+static void UpdatePins(void) {
+    sfr[SFR_PORTB]=(sfr[SFR_LATB]&~sfr[SFR_TRISB])|(panel.pins[0]&sfr[SFR_TRISB]);
+    sfr[SFR_PORTC]=(sfr[SFR_LATC]&~sfr[SFR_TRISC])|(panel.pins[1]&sfr[SFR_TRISC]);
+}
+
+//
+// Hold a button down for ms from the given time on
+//
+int sim_press(double seconds, int button, double ms) {
+    if (button<0 || button>SIM_BUT_PUSH || ms<=0) return -1;
+    return Contact(seconds, buttons[button].port, buttons[button].mask, 0)
+        | Contact(seconds+ms/1000.0, buttons[button].port, buttons[button].mask, 1);
+}
+
+//
+// Turn the knob by detents, clockwise when positive, taking ms for each.
+// A detent is a full cycle of the two contacts, A leads going clockwise.
+//
+int sim_turn(double seconds, int detents, double msPerDetent) {
+    uint8_t first=detents<0 ? ENC_B : ENC_A;
+    uint8_t second=detents<0 ? ENC_A : ENC_B;
+    double q=msPerDetent/4000.0;
+    int err=0;
+    if (msPerDetent<=0) return -1;
+    for (int i=0; i<abs(detents); i++) {
+        double t=seconds+i*4*q;
+        err|=Contact(t, 1, first, 0);
+        err|=PinAt(t+q, 1, second, 0);
+        err|=PinAt(t+2*q, 1, first, 1);
+        err|=PinAt(t+3*q, 1, second, 1);
+    }
+    return err;
+}
+
+
+
+//
+// USB engine and the host at the other end of the cable. The host resets
+// the bus once the pull-up is on and enumerates the device the way Linux
+// would before opening a CDC port, then reads bulk IN as fast as the
+// device sends. It has a go at one transaction every USB_STEP, the device
+// only sees them through the buffer descriptors in the USB RAM and USTAT.
+// Ping-pong buffering isn't modelled.
+//
+// With the cable out the bus goes quiet and the SIE raises IDLEIF after
+// USB_IDLE. With it in, every step is activity and raises ACTVIF, the one
+// thing the SIE still does suspended or with the chip asleep.
+//
+#define BD_UOWN         0x80
+#define BD_DTS          0x40
+#define BD_DTSEN        0x08
+#define BD_BSTALL       0x04
+#define PID_OUT         0x01
+#define PID_IN          0x09
+#define PID_SETUP       0x0D
+
+static const struct {
+    uint8_t setup[8];
+    uint8_t data[8];        // The OUT data stage
+} enumeration[]={
+    { { 0x80, 0x06, 0x00, 0x01, 0, 0, 64, 0 } },        // Device descriptor, first 64
+    { { 0x00, 0x05, 0x07, 0x00, 0, 0, 0, 0 } },         // SET_ADDRESS 7
+    { { 0x80, 0x06, 0x00, 0x01, 0, 0, 18, 0 } },        // Device descriptor
+    { { 0x80, 0x06, 0x00, 0x02, 0, 0, 9, 0 } },         // Configuration, for its length
+    { { 0x80, 0x06, 0x00, 0x02, 0, 0, 255, 0 } },       // and all of it
+    { { 0x00, 0x09, 0x01, 0x00, 0, 0, 0, 0 } },         // SET_CONFIGURATION 1
+    { { 0x21, 0x20, 0x00, 0x00, 0, 0, 7, 0 }, { 0x00, 0xC2, 0x01, 0x00, 0, 0, 8 } },
+    { { 0x21, 0x22, 0x03, 0x00, 0, 0, 0, 0 } },         // DTR and RTS, the port is open
+};
+
+#define ENUMERATION     (sizeof(enumeration)/sizeof(enumeration[0]))
+
+static volatile uint8_t *Bd(int n) {
+    return &simUsbRam[n*4];
+}
+
+static volatile uint8_t *BdBuffer(volatile uint8_t *bd, uint16_t n) {
+    uint16_t a=(uint16_t)(bd[3]<<8)|bd[2];
+    if (a<SIM_USB_RAM || a+n>SIM_USB_RAM+sizeof(simUsbRam)) {
+        simStats.usbErrors++;
+        return NULL;
+    }
+    return &simUsbRam[a-SIM_USB_RAM];
+}
+
+static uint16_t BdCount(volatile uint8_t *bd) {
+    return (uint16_t)((bd[0]&3)<<8)|bd[1];
+}
+
+// The SIE is done with a buffer descriptor, USTAT says which
+static void UsbDone(volatile uint8_t *bd, uint8_t pid, uint8_t ustat) {
+    bd[0]=(uint8_t)((bd[0]&BD_DTS)|(pid<<2));
+    if (!REG(UIRbits_t, SFR_UIR).TRNIF && !usb.fifoN) {
+        sfr[SFR_USTAT]=ustat;
+        REG(UIRbits_t, SFR_UIR).TRNIF=1;
+    } else {
+        usb.fifo[usb.fifoN++]=ustat;
+    }
+}
+
+static int UsbToggle(volatile uint8_t *bd, uint8_t *toggle) {
+    int ok=!(bd[0]&BD_DTSEN) || !!(bd[0]&BD_DTS)==*toggle;
+    if (!ok) simStats.usbErrors++;
+    *toggle^=1;
+    return ok;
+}
+
+// The device has answered a request in full
+static void UsbRequestDone(void) {
+    const uint8_t *setup=enumeration[usb.req].setup;
+    uint8_t *r=usb.reply;
+
+    if (setup[1]==0x06 && setup[3]==1) {
+        if (usb.sent<18 || r[0]!=18 || r[1]!=1 || r[7]!=8) simStats.usbErrors++;
+    } else if (setup[1]==0x06 && setup[3]==2) {
+        if (usb.sent<9 || r[1]!=2) {
+            simStats.usbErrors++;
+        } else if (setup[6]==9) {
+            usb.configLength=(uint16_t)(r[3]<<8)|r[2];
+        } else {
+            // A bulk IN endpoint 2 has to be there
+            int bulk=0;
+            for (int i=0; i+1<usb.sent && r[i]; i+=r[i]) {
+                if (r[i+1]==5 && r[i+2]==0x82 && r[i+3]==2) bulk=1;
+            }
+            if (usb.sent!=usb.configLength || !bulk) simStats.usbErrors++;
+        }
+    } else if (setup[1]==0x05) {
+        usb.addr=setup[2];
+    }
+    usb.stage=US_SETUP;
+    if (++usb.req>=ENUMERATION) {
+        usb.state=UH_STREAM;
+        usb.bulkToggle=0;
+        simStats.usbConfigured=s.cycle;
+    }
+}
+
+static void UsbControl(void) {
+    const uint8_t *setup=enumeration[usb.req].setup;
+    uint16_t length=(uint16_t)(setup[7]<<8)|setup[6];
+    volatile uint8_t *out=Bd(0), *in=Bd(1), *buf;
+    uint16_t n;
+
+    // Not addressed to it yet, or it's still busy with a SETUP
+    if ((sfr[SFR_UADDR]&0x7F)!=usb.addr || !(sfr[SFR_UEP0]&0x10)
+            || (usb.stage!=US_SETUP && REG(UCONbits_t, SFR_UCON).PKTDIS)) {
+        simStats.usbNaks++;
+        return;
+    }
+    switch (usb.stage) {
+        case US_SETUP:
+            if (!(out[0]&BD_UOWN) || BdCount(out)<8 || !(buf=BdBuffer(out, 8))) {
+                simStats.usbNaks++;
+                return;
+            }
+            memcpy((void *)buf, setup, 8);
+            out[1]=8;
+            REG(UCONbits_t, SFR_UCON).PKTDIS=1;
+            UsbDone(out, PID_SETUP, 0x00);
+            usb.toggle=1;
+            usb.sent=0;
+            usb.stage=!length ? US_STATUS_IN : setup[0]&0x80 ? US_IN : US_OUT;
+            break;
+
+        case US_IN:
+        case US_STATUS_IN:
+            if (!(in[0]&BD_UOWN)) {
+                simStats.usbNaks++;
+                return;
+            }
+            if (in[0]&BD_BSTALL) {
+                simStats.usbErrors++;
+                REG(UIRbits_t, SFR_UIR).STALLIF=1;
+                usb.stage=US_SETUP;
+                usb.req++;
+                return;
+            }
+            n=BdCount(in);
+            if (n>8 || !(buf=BdBuffer(in, n))) {
+                simStats.usbErrors++;
+                n=0;
+            }
+            if (usb.stage==US_STATUS_IN) {
+                if (n || !(in[0]&BD_DTS)) simStats.usbErrors++;
+                UsbDone(in, PID_IN, 0x04);
+                UsbRequestDone();
+                break;
+            }
+            UsbToggle(in, &usb.toggle);
+            if (n && usb.sent+n<=sizeof(usb.reply)) memcpy(usb.reply+usb.sent, (void *)buf, n);
+            usb.sent+=n;
+            UsbDone(in, PID_IN, 0x04);
+            if (n<8 || usb.sent>=length) usb.stage=US_STATUS_OUT;
+            break;
+
+        case US_OUT:
+        case US_STATUS_OUT:
+            if (!(out[0]&BD_UOWN)) {
+                simStats.usbNaks++;
+                return;
+            }
+            n=usb.stage==US_OUT ? length-usb.sent : 0;
+            if (n>8) n=8;
+            if (n>BdCount(out) || !(buf=BdBuffer(out, n))) {
+                simStats.usbErrors++;
+                return;
+            }
+            memcpy((void *)buf, enumeration[usb.req].data+usb.sent, n);
+            out[0]=(uint8_t)((out[0]&~BD_DTS)|(usb.stage==US_STATUS_OUT || usb.toggle ? BD_DTS : 0));
+            out[1]=(uint8_t)n;
+            usb.toggle^=1;
+            usb.sent+=n;
+            UsbDone(out, PID_OUT, 0x00);
+            if (usb.stage==US_STATUS_OUT) UsbRequestDone();
+            else if (usb.sent>=length) usb.stage=US_STATUS_IN;
+            break;
+    }
+}
+
+static void UsbBulkIn(void) {
+    volatile uint8_t *in=Bd(5), *buf;
+    uint16_t n;
+
+    if (!(sfr[SFR_UEP2]&0x02) || !(in[0]&BD_UOWN)) return;
+    n=BdCount(in);
+    if (n>64 || !(buf=BdBuffer(in, n))) {
+        simStats.usbErrors++;
+        n=0;
+    }
+    UsbToggle(in, &usb.bulkToggle);
+    if (simStats.usbBytes+n>usb.streamSize) {
+        usb.streamSize=usb.streamSize ? usb.streamSize*2 : 65536;
+        usb.stream=realloc(usb.stream, usb.streamSize);
+    }
+    memcpy(usb.stream+simStats.usbBytes, (void *)buf, n);
+    simStats.usbBytes+=n;
+    simStats.usbPackets++;
+    UsbDone(in, PID_IN, (2<<3)|0x04);
+}
+
+static void UsbStep(void) {
+    int attached=REG(UCONbits_t, SFR_UCON).USBEN && REG(UCFGbits_t, SFR_UCFG).UPUEN;
+    int cable=s.cycle>=usb.plugAt && s.cycle<usb.unplugAt;
+
+    usb.next+=USB_STEP;
+    if (!attached || !cable) {
+        usb.state=UH_DETACHED;
+        if (attached && !usb.idle && s.cycle-usb.activeAt>=USB_IDLE) {
+            REG(UIRbits_t, SFR_UIR).IDLEIF=1;
+            usb.idle=1;
+        }
+        return;
+    }
+    usb.activeAt=s.cycle;
+    usb.idle=0;
+    REG(UIRbits_t, SFR_UIR).ACTVIF=1;
+    if (REG(UCONbits_t, SFR_UCON).SUSPND || s.power>=PW_SLEEP) return;
+    if (++usb.steps>=8) {
+        usb.steps=0;
+        usb.frame=(usb.frame+1)&0x7FF;
+        sfr[SFR_UFRML]=(uint8_t)usb.frame;
+        sfr[SFR_UFRMH]=(uint8_t)(usb.frame>>8);
+        REG(UIRbits_t, SFR_UIR).SOFIF=1;
+    }
+    switch (usb.state) {
+        case UH_DETACHED:
+            usb.state=UH_RESET;
+            usb.resetEnd=s.cycle+USB_RESET;
+            usb.addr=0;
+            usb.req=0;
+            usb.stage=US_SETUP;
+            usb.fifoN=0;
+            REG(UIRbits_t, SFR_UIR).URSTIF=1;
+            break;
+        case UH_RESET:
+            if (s.cycle>=usb.resetEnd && !REG(UIRbits_t, SFR_UIR).URSTIF) usb.state=UH_ENUMERATE;
+            break;
+        case UH_ENUMERATE:
+            if (usb.fifoN<sizeof(usb.fifo)) UsbControl();
+            break;
+        case UH_STREAM:
+            if (usb.fifoN<sizeof(usb.fifo)) UsbBulkIn();
+            break;
+    }
+}
+
+
+
+//
+// Timers
+//
+static uint32_t T0Prescale(void) {
+    T0CONbits_t c=REG(T0CONbits_t, SFR_T0CON);
+    return c.PSA ? 1 : 2u<<c.T0PS;
+}
+
+static uint32_t T0Max(void) {
+    return REG(T0CONbits_t, SFR_T0CON).T08BIT ? 0xFF : 0xFFFF;
+}
+
+static int T0Running(void) {
+    T0CONbits_t c=REG(T0CONbits_t, SFR_T0CON);
+    return c.TMR0ON && !c.T0CS;
+}
+
+static uint32_t T1Prescale(void) {
+    return 1u<<REG(T1CONbits_t, SFR_T1CON).T1CKPS;
+}
+
+static int T1Running(void) {
+    T1CONbits_t c=REG(T1CONbits_t, SFR_T1CON);
+    return c.TMR1ON && !c.TMR1CS;
+}
+
+static uint32_t T3Prescale(void) {
+    return 1u<<REG(T3CONbits_t, SFR_T3CON).T3CKPS;
+}
+
+static int T3Running(void) {
+    T3CONbits_t c=REG(T3CONbits_t, SFR_T3CON);
+    return c.TMR3ON && !c.TMR3CS;
+}
+
+static uint32_t T2Prescale(void) {
+    static const uint8_t ps[4]={1, 4, 16, 16};
+    return ps[REG(T2CONbits_t, SFR_T2CON).T2CKPS];
+}
+
+static uint32_t T2Distance(void) {
+    uint8_t pr=sfr[SFR_PR2];
+    return s.tmr2<=pr ? pr-s.tmr2+1u : 256u-s.tmr2+pr+1u;
+}
+
+static uint64_t CyclesToEvent(void) {
+    uint64_t next=NEVER;
+    if (s.power<PW_SLEEP && T0Running()) {
+        uint64_t c=(uint64_t)(T0Max()+1-(s.tmr0&T0Max()))*T0Prescale()-s.pre0;
+        if (c<next) next=c;
+    }
+    if (s.power<PW_SLEEP && T1Running()) {
+        uint64_t c=(uint64_t)(0x10000-s.tmr1)*T1Prescale()-s.pre1;
+        if (c<next) next=c;
+    }
+    if (s.power<PW_SLEEP && REG(T2CONbits_t, SFR_T2CON).TMR2ON) {
+        uint64_t c=(uint64_t)T2Distance()*T2Prescale()-s.pre2;
+        if (c<next) next=c;
+    }
+    if (s.power<PW_SLEEP && T3Running()) {
+        uint64_t c=(uint64_t)(0x10000-s.tmr3)*T3Prescale()-s.pre3;
+        if (c<next) next=c;
+    }
+    if (s.sspBusy && s.sspDone-s.cycle<next) next=s.sspDone>s.cycle ? s.sspDone-s.cycle : 1;
+    if (s.eeBusy && s.eeDone-s.cycle<next) next=s.eeDone>s.cycle ? s.eeDone-s.cycle : 1;
+    if (s.nextEdge!=NEVER && s.nextEdge-s.cycle<next) next=s.nextEdge>s.cycle ? s.nextEdge-s.cycle : 1;
+    if (s.pulses && s.pulse[0].at-s.cycle<next) next=s.pulse[0].at>s.cycle ? s.pulse[0].at-s.cycle : 1;
+    if (usb.host && usb.next-s.cycle<next) next=usb.next>s.cycle ? usb.next-s.cycle : 1;
+    if (panel.next<panel.changes) {
+        uint64_t at=panel.change[panel.next].at;
+        if (at-s.cycle<next) next=at>s.cycle ? at-s.cycle : 1;
+    }
+    return next;
+}
+
+//
+// Tach edges. The rotor passes the sensor at the edges of the profile, the
+// pulses that reach INT1 are those with the noise of the segment added.
+// They're worked out a revolution ahead, when the edge before has passed.
+//
+static double Random(void) {
+    // xorshift, the same noise every run
+    s.random^=s.random<<13;
+    s.random^=s.random>>17;
+    s.random^=s.random<<5;
+    return s.random/4294967296.0;
+}
+
+static void AddPulse(uint64_t at, uint64_t edge, uint8_t bounce) {
+    int i;
+    if (s.pulses>=MAXPULSES) return;
+    for (i=s.pulses; i>0 && s.pulse[i-1].at>at; i--) s.pulse[i]=s.pulse[i-1];
+    s.pulse[i].at=at;
+    s.pulse[i].edge=edge;
+    s.pulse[i].bounce=bounce;
+    s.pulses++;
+}
+
+static void SchedulePulses(uint64_t at, uint64_t edge) {
+    const Noise *n=&prof.seg[SegmentAt((double)at/SIM_FCY)].noise;
+    int64_t jitter;
+
+    if (n->dropout && edge%n->dropout==0) {
+        simStats.edgesDropped++;
+        return;
+    }
+    jitter=llround((2*Random()-1)*n->jitter*SIM_FCY);
+    at=jitter<0 && (uint64_t)-jitter>at-s.cycle ? s.cycle : at+jitter;
+    AddPulse(at, edge, 0);
+    for (int i=1; i<=n->bounces; i++) AddPulse(at+(uint64_t)llround(i*n->bounceGap*SIM_FCY), edge, 1);
+}
+
+static void TachEdge(void) {
+    simStats.edges++;
+    s.lastEdge=s.nextEdge;
+    s.edgeAt[simStats.edges&(EDGEHISTORY-1)]=s.nextEdge;
+    s.nextEdge=NextEdge(s.nextEdge);
+    if (s.nextEdge!=NEVER) SchedulePulses(s.nextEdge, simStats.edges+1);
+}
+
+static void TachPulse(void) {
+    Pulse p=s.pulse[0];
+    memmove(s.pulse, s.pulse+1, --s.pulses*sizeof(Pulse));
+    simStats.pulses++;
+    if (p.bounce) simStats.bounces++;
+    else s.lastPulse=p.at;
+    if (REG(INTCON3bits_t, SFR_INTCON3).INT1IF) {
+        simStats.edgesMerged++;
+    } else {
+        REG(INTCON3bits_t, SFR_INTCON3).INT1IF=1;
+        s.int1EdgeAt=p.at;
+        s.int1Edge=p.edge;
+    }
+}
+
+// Advance all peripherals by dt cycles, dt never passes the next event
+static void Tick(uint64_t dt) {
+    int clock=s.power<PW_SLEEP;
+
+    if (clock && T0Running()) {
+        uint32_t ps=T0Prescale();
+        uint64_t total=s.pre0+dt;
+        uint64_t v=(s.tmr0&T0Max())+total/ps;
+        s.pre0=total%ps;
+        s.tmr0Ticks+=total/ps;
+        if (v>T0Max()) REG(INTCONbits_t, SFR_INTCON).TMR0IF=1;
+        s.tmr0=(s.tmr0&~T0Max())|(v&T0Max());
+    }
+    if (clock && T1Running()) {
+        uint32_t ps=T1Prescale();
+        uint64_t total=s.pre1+dt;
+        uint64_t v=s.tmr1+total/ps;
+        s.pre1=total%ps;
+        if (v>0xFFFF) REG(PIR1bits_t, SFR_PIR1).TMR1IF=1;
+        s.tmr1=(uint16_t)v;
+    }
+    if (clock && REG(T2CONbits_t, SFR_T2CON).TMR2ON) {
+        uint32_t ps=T2Prescale();
+        uint64_t total=s.pre2+dt;
+        uint64_t inc=total/ps;
+        s.pre2=total%ps;
+        if (inc>=T2Distance()) {
+            s.tmr2=0;
+            if (++s.post2>REG(T2CONbits_t, SFR_T2CON).T2OUTPS) {
+                s.post2=0;
+                REG(PIR1bits_t, SFR_PIR1).TMR2IF=1;
+            }
+        } else {
+            s.tmr2=(uint8_t)(s.tmr2+inc);
+        }
+    }
+    if (clock && T3Running()) {
+        uint32_t ps=T3Prescale();
+        uint64_t total=s.pre3+dt;
+        uint64_t v=s.tmr3+total/ps;
+        s.pre3=total%ps;
+        if (v>0xFFFF) REG(PIR2bits_t, SFR_PIR2).TMR3IF=1;
+        s.tmr3=(uint16_t)v;
+    }
+    s.cycle+=dt;
+    if (s.power==PW_SLEEP) simStats.sleepCycles+=dt;
+    else if (s.power!=PW_RUN) simStats.idleCycles+=dt;
+    else if (!s.inIsr) simStats.mainCycles+=dt;
+    if (s.sspBusy && s.sspDone<=s.cycle) {
+        s.sspBusy=0;
+        REG(SSPSTATbits_t, SFR_SSPSTAT).BF=1;
+        REG(PIR1bits_t, SFR_PIR1).SSPIF=1;
+        simStats.spiBytes++;
+        if (!(s.latc&0x40)) LcdBits(s.sspData, 8);
+    }
+    if (s.eeBusy && s.eeDone<=s.cycle) {
+        s.eeBusy=0;
+        simEeprom[s.eeAddr]=s.eeData;
+        if (++eeWear[s.eeAddr]>simStats.eeWear) simStats.eeWear=eeWear[s.eeAddr];
+        simStats.eeWrites++;
+        REG(EECON1bits_t, SFR_EECON1).WR=0;
+        REG(PIR2bits_t, SFR_PIR2).EEIF=1;
+    }
+    while (s.nextEdge<=s.cycle) TachEdge();
+    while (s.pulses && s.pulse[0].at<=s.cycle) TachPulse();
+    while (usb.host && usb.next<=s.cycle) UsbStep();
+    PinChanges();
+}
+
+
+
+//
+// Where the rotor really is when the LED goes on, compared with where the
+// flash was asked for. The rotor turns at a steady speed between edges.
+//
+static void AngleError(void) {
+    // The edge the revolution started on may be one still to come, when
+    // its pulse was early
+    int64_t since=(int64_t)(simStats.edges-s.revEdge)%prof.edgesPerRev;
+    double pos=(double)(since<0 ? since+prof.edgesPerRev : since);
+    pos+=(double)(s.cycle-s.lastEdge)/(double)(s.nextEdge-s.lastEdge);
+    double err=pos/prof.edgesPerRev*s.flashes-s.angle/360.0*s.flashes;
+    err-=floor(err+0.5);
+    err*=360.0/s.flashes;
+    sim_stat_add(&simStats.angleError, (uint64_t)llround(fabs(err)*1000.0));
+}
+
+
+
+//
+// A flash while running free, against a grid of ideal flashes at the set
+// rate starting from the first one. Flashes left out for the power budget
+// leave holes in the grid.
+//
+static void FreeFlash(void) {
+    double t=SIM_FCY/s.freeHz;
+    if (!simStats.freeFirst && !simStats.freeLast) {
+        simStats.freeFirst=simStats.freeLast=s.cycle;
+        return;
+    }
+    double since=(double)(s.cycle-simStats.freeFirst);
+    uint64_t k=(uint64_t)llround(since/t);
+    double grid=since-k*t;
+    sim_stat_add(&simStats.freeGrid, (uint64_t)llround(fabs(grid)*1e9/SIM_FCY));
+    if (k==s.freeK+1) {
+        double err=(double)(s.cycle-simStats.freeLast)-t;
+        sim_stat_add(&simStats.freeInterval, (uint64_t)llround(fabs(err)*1e9/SIM_FCY));
+    }
+    s.freeK=k;
+    simStats.freeLast=s.cycle;
+    simStats.freeFlashes=k;
+}
+
+
+
+//
+// The reading the display shows against the RPM the motor turns at, and
+// how long after each steady segment starts it settles to it for good
+//
+static void Settle(void) {
+    const Segment *g;
+
+    if (s.readingSegment<0) return;
+    g=&prof.seg[s.readingSegment];
+    if (g->rpmFrom!=g->rpmTo || g->rpmFrom<MINRPM) return;
+    if (s.inTolerance) sim_stat_add(&simStats.settle, s.settledAt-(uint64_t)llround(g->start*SIM_FCY));
+    else simStats.unsettled++;
+}
+
+static void Reading(uint16_t shown, uint8_t range) {
+    static const double units[RPM_RANGES]={ 0.001, 0.01, 0.1, 1, 100 };
+    double t=(double)s.cycle/SIM_FCY, rpm=sim_rpm_at(t), err;
+    int segment=SegmentAt(t);
+
+    // Running free it shows the flash rate
+    if (s.freeHz>0 || range>=RPM_RANGES) return;
+    if (segment!=s.readingSegment) {
+        Settle();
+        s.readingSegment=segment;
+        s.inTolerance=0;
+    }
+    if (rpm<MINRPM) return;
+    err=fabs(shown*units[range]-rpm)/rpm;
+    sim_stat_add(&simStats.readingError, (uint64_t)llround(err*1e6));
+    if (err>SETTLED) {
+        s.inTolerance=0;
+    } else if (!s.inTolerance) {
+        s.inTolerance=1;
+        s.settledAt=s.cycle;
+    }
+}
+
+
+
+//
+// Register file bookkeeping
+//
+static void Commit(void) {
+    if (sfr[SFR_TMR0L]!=s.pubTmr0l) {
+        // A TMR0L write loads the whole counter from the TMR0H buffer
+        sfr[SFR_TMR0H]=s.tmr0hBuf;
+        s.tmr0=(uint16_t)(s.tmr0hBuf<<8)|sfr[SFR_TMR0L];
+        s.pre0=0;
+        s.pubTmr0l=sfr[SFR_TMR0L];
+    }
+    s.tmr0hBuf=sfr[SFR_TMR0H];
+
+    if (sfr[SFR_TMR1L]!=s.pubTmr1l || sfr[SFR_TMR1H]!=s.pubTmr1h) {
+        s.tmr1=(uint16_t)(sfr[SFR_TMR1H]<<8)|sfr[SFR_TMR1L];
+        s.pubTmr1l=sfr[SFR_TMR1L];
+        s.pubTmr1h=sfr[SFR_TMR1H];
+    }
+
+    if (sfr[SFR_TMR3L]!=s.pubTmr3l || sfr[SFR_TMR3H]!=s.pubTmr3h) {
+        s.tmr3=(uint16_t)(sfr[SFR_TMR3H]<<8)|sfr[SFR_TMR3L];
+        s.pre3=0;
+        s.pubTmr3l=sfr[SFR_TMR3L];
+        s.pubTmr3h=sfr[SFR_TMR3H];
+    }
+
+    if (sfr[SFR_TMR2]!=s.pubTmr2 || sfr[SFR_T2CON]!=s.pubT2con) {
+        s.tmr2=sfr[SFR_TMR2];
+        s.pre2=0;
+        s.post2=0;
+        s.pubTmr2=sfr[SFR_TMR2];
+        s.pubT2con=sfr[SFR_T2CON];
+    }
+
+    if (s.sspWrite) {
+        s.sspWrite=0;
+        if (REG(SSPCON1bits_t, SFR_SSPCON1).SSPEN) {
+            static const uint16_t bitTime[4]={1, 4, 16, 16};
+            s.sspBusy=1;
+            s.sspData=sfr[SFR_SSPBUF];
+            s.sspDone=s.cycle+8u*bitTime[REG(SSPCON1bits_t, SFR_SSPCON1).SSPM&3];
+        }
+    }
+
+    // Data EEPROM. A write only starts when WR is set right after 0x55
+    // and 0xAA have gone into EECON2 with the interrupts off, anything
+    // else in between breaks the sequence.
+    EECON1bits_t ee=REG(EECON1bits_t, SFR_EECON1);
+    if (sfr[SFR_EECON2]) {
+        if (REG(INTCONbits_t, SFR_INTCON).GIE) s.eeUnlock=0;
+        else if (sfr[SFR_EECON2]==0x55) s.eeUnlock=1;
+        else if (sfr[SFR_EECON2]==0xAA && s.eeUnlock==1) s.eeUnlock=2;
+        else s.eeUnlock=0;
+        sfr[SFR_EECON2]=0;          // Reads as zero
+    } else if (ee.WR && !s.eeBusy) {
+        if (s.eeUnlock==2 && ee.WREN && !ee.EEPGD && !ee.CFGS) {
+            s.eeBusy=1;
+            s.eeAddr=sfr[SFR_EEADR];
+            s.eeData=sfr[SFR_EEDATA];
+            s.eeDone=s.cycle+SIM_EEPROM_WRITE;
+        } else {
+            REG(EECON1bits_t, SFR_EECON1).WR=0;
+            simStats.eeRefused++;
+        }
+        s.eeUnlock=0;
+    } else {
+        s.eeUnlock=0;
+    }
+    if (ee.RD) {
+        if (!ee.EEPGD && !ee.CFGS) sfr[SFR_EEDATA]=simEeprom[sfr[SFR_EEADR]];
+        REG(EECON1bits_t, SFR_EECON1).RD=0;
+    }
+
+    // Clearing TRNIF brings up the next transaction in USTAT
+    if (usb.fifoN && !REG(UIRbits_t, SFR_UIR).TRNIF) {
+        sfr[SFR_USTAT]=usb.fifo[0];
+        memmove(usb.fifo, usb.fifo+1, --usb.fifoN);
+        REG(UIRbits_t, SFR_UIR).TRNIF=1;
+    }
+
+    uint8_t latb=sfr[SFR_LATB];
+    uint8_t latc=sfr[SFR_LATC];
+    if ((latb&~s.latb&0x40) && !(latc&0x40) && !REG(SSPCON1bits_t, SFR_SSPCON1).SSPEN) {
+        LcdBits((latc>>7)&1, 1);    // D/C bit clocked in by hand on RB6
+    }
+    if (latc&~s.latc&0x40) {
+        s.lcdShift=0;               // Chip select going high drops a partial word
+        s.lcdBits=0;
+    }
+    if ((latc^s.latc)&0x01) {
+        if (latc&0x01) {
+            s.ledOnAt=s.cycle;
+            s.ledFlash=s.inIsr;
+            simStats.ledFlashes++;
+            sim_stat_add(&simStats.ledDelay, s.cycle-s.lastPulse);
+            if (s.flashPending) {
+                int64_t err=(int64_t)(s.cycle-s.flashAt);
+                sim_stat_add(&simStats.flashError, (uint64_t)(err<0 ? -err : err));
+                simStats.flashBias+=err;
+                s.flashPending=0;
+            }
+            if (s.angle>=0 && s.revEdge && s.nextEdge!=NEVER) AngleError();
+            if (s.freeHz>0 && s.inIsr) FreeFlash();
+        } else {
+            sim_stat_add(&simStats.ledOn, s.cycle-s.ledOnAt);
+            if (s.ledFlash) simStats.flashOnCycles+=s.cycle-s.ledOnAt;
+        }
+    }
+    s.latb=latb;
+    s.latc=latc;
+}
+
+static void Publish(void) {
+    sfr[SFR_TMR0L]=(uint8_t)s.tmr0;
+    s.pubTmr0l=sfr[SFR_TMR0L];
+    sfr[SFR_TMR1L]=(uint8_t)s.tmr1;
+    sfr[SFR_TMR1H]=(uint8_t)(s.tmr1>>8);
+    s.pubTmr1l=sfr[SFR_TMR1L];
+    s.pubTmr1h=sfr[SFR_TMR1H];
+    sfr[SFR_TMR2]=s.tmr2;
+    s.pubTmr2=s.tmr2;
+    s.pubT2con=sfr[SFR_T2CON];
+    sfr[SFR_TMR3L]=(uint8_t)s.tmr3;
+    sfr[SFR_TMR3H]=(uint8_t)(s.tmr3>>8);
+    s.pubTmr3l=sfr[SFR_TMR3L];
+    s.pubTmr3h=sfr[SFR_TMR3H];
+}
+
+
+
+//
+// Interrupts
+//
+// An enabled source has its flag up, which wakes the chip whether or not
+// GIE lets it go to the ISR
+static int Requested(void) {
+    INTCONbits_t ic=REG(INTCONbits_t, SFR_INTCON);
+    INTCON3bits_t ic3=REG(INTCON3bits_t, SFR_INTCON3);
+    if (ic.TMR0IE && ic.TMR0IF) return 1;
+    if (ic.INT0IE && ic.INT0IF) return 1;
+    if (ic.RABIE && ic.RABIF) return 1;
+    if (ic3.INT1IE && ic3.INT1IF) return 1;
+    // USBIF is set by the flags in UIR that UIE lets through
+    if (sfr[SFR_UIR]&sfr[SFR_UIE]) REG(PIR2bits_t, SFR_PIR2).USBIF=1;
+    if (!ic.PEIE) return 0;
+    return (sfr[SFR_PIE1]&sfr[SFR_PIR1]) || (sfr[SFR_PIE2]&sfr[SFR_PIR2]);
+}
+
+static int Pending(void) {
+    return REG(INTCONbits_t, SFR_INTCON).GIE && Requested();
+}
+
+static void Run(uint64_t n);
+
+static void Dispatch(void) {
+    uint64_t start=s.cycle;
+    INTCON3bits_t ic3=REG(INTCON3bits_t, SFR_INTCON3);
+    int int1=ic3.INT1IE && ic3.INT1IF;
+
+    s.inIsr=1;
+    REG(INTCONbits_t, SFR_INTCON).GIE=0;
+    Run(CY_ISR_ENTRY);
+    if (int1) sim_stat_add(&simStats.int1Latency, s.cycle-s.int1EdgeAt);
+    Publish();
+    ISR();
+    Commit();
+    Run(CY_ISR_EXIT);
+    REG(INTCONbits_t, SFR_INTCON).GIE=1;
+    s.inIsr=0;
+    simStats.isrCount++;
+    sim_stat_add(&simStats.isrCycles, s.cycle-start);
+}
+
+static void Run(uint64_t n) {
+    uint64_t target=s.cycle+n;
+    for (;;) {
+        if (!s.inIsr && Pending()) {
+            uint64_t before=s.cycle;
+            Dispatch();
+            target+=s.cycle-before;
+            continue;
+        }
+        if (s.cycle>=target) break;
+        uint64_t dt=CyclesToEvent();
+        if (dt>target-s.cycle) dt=target-s.cycle;
+        Tick(dt);
+    }
+}
+
+static void Enter(void) {
+    Commit();
+    if (!s.inIsr && s.cycle>=s.end) longjmp(s.exit, 1);
+}
+
+
+
+//
+// Firmware facing entry points
+//
+volatile uint8_t *sim_sfr(uint8_t addr) {
+    Enter();
+    Run(1);
+    if (addr==SFR_SSPBUF) {
+        // Reading a full buffer empties it, otherwise it's a write
+        if (REG(SSPSTATbits_t, SFR_SSPSTAT).BF) REG(SSPSTATbits_t, SFR_SSPSTAT).BF=0;
+        else if (!s.sspBusy) s.sspWrite=1;
+    }
+    Publish();
+    if (addr==SFR_PORTB || addr==SFR_PORTC) UpdatePins();
+    if (addr==SFR_TMR0L) {
+        s.tmr0hBuf=sfr[SFR_TMR0H];
+        sfr[SFR_TMR0H]=(uint8_t)(s.tmr0>>8);
+    }
+    return &sfr[addr];
+}
+
+void sim_cycles(uint32_t n) {
+    Enter();
+    Run(n);
+    Publish();
+}
+
+//
+// SLEEP. With IDLEN set only the CPU stops, otherwise the oscillator does
+// too, and takes SIM_WAKEUP to start up again once something wakes the
+// chip. A source that's already requesting makes it a NOP. The one that
+// woke it goes to the ISR straight away if GIE is set, the firmware
+// carries on after SLEEP when it's back.
+//
+void sim_sleep(void) {
+    int idle=REG(OSCCONbits_t, SFR_OSCCON).IDLEN;
+    uint64_t dt, until;
+
+    Enter();
+    Run(1);
+    s.power=idle ? PW_IDLE : PW_SLEEP;
+    while (!Requested()) {
+        if (s.cycle>=s.end) longjmp(s.exit, 1);
+        dt=CyclesToEvent();
+        if (dt>s.end-s.cycle) dt=s.end-s.cycle;
+        Tick(dt);
+    }
+    if (!idle) {
+        s.power=PW_WAKE;
+        until=s.cycle+SIM_WAKEUP;
+        while (s.cycle<until) {
+            dt=CyclesToEvent();
+            if (dt>until-s.cycle) dt=until-s.cycle;
+            Tick(dt);
+        }
+    }
+    s.power=PW_RUN;
+    Run(0);
+    Publish();
+}
+
+void sim_event(int ev) {
+    if (ev==SIM_EV_LOOP) {
+        // A pass that consumed a sample or an input, redrew or talked to
+        // the LCD is busy, the rest are the main loop waiting for something
+        // to do. The time it spent idle or asleep isn't part of the pass.
+        uint64_t work=simStats.events[SIM_EV_SAMPLE]+simStats.events[SIM_EV_FRAME]
+            +simStats.events[SIM_EV_INPUT]+simStats.spiBytes;
+        uint64_t stopped=simStats.idleCycles+simStats.sleepCycles;
+        if (simStats.events[ev]) {
+            sim_stat_add(&simStats.loopCycles, s.cycle-s.loopAt-(stopped-s.loopStopped));
+            if (work!=s.loopWork) simStats.busyCycles+=simStats.mainCycles-s.loopMain;
+        }
+        s.loopAt=s.cycle;
+        s.loopMain=simStats.mainCycles;
+        s.loopStopped=stopped;
+        s.loopWork=work;
+    }
+    if (ev>=0 && ev<SIM_EV_COUNT) simStats.events[ev]++;
+}
+
+void sim_trace(int id, uint32_t v) {
+    switch (id) {
+        case SIM_TR_PERIOD:
+            // After a stall the firmware starts afresh on whichever edge
+            // comes next, the angle can't be checked until it has
+            if (!v) {
+                s.revEdge=0;
+                break;
+            }
+            // Compare against the revolution that ended with the last edge
+            if (simStats.edges>prof.edgesPerRev) {
+                uint64_t e=simStats.edges;
+                int64_t truth=(int64_t)(s.edgeAt[e&(EDGEHISTORY-1)]-s.edgeAt[(e-prof.edgesPerRev)&(EDGEHISTORY-1)]);
+                int64_t err=(int64_t)v-truth;
+                sim_stat_add(&simStats.periodError, (uint64_t)(err<0 ? -err : err));
+            }
+            s.revEdge=s.int1Edge;
+            break;
+
+        case SIM_TR_FLASH:
+            // A time on the firmware's timebase, the low 32 bits of Timer0
+            s.flashAt=s.cycle+(int64_t)(int32_t)(v-(uint32_t)s.tmr0Ticks)*T0Prescale()-s.pre0;
+            s.flashPending=1;
+            break;
+
+        case SIM_TR_READING:
+            Reading((uint16_t)v, (uint8_t)(v>>16));
+            break;
+    }
+}
+
+
+
+//
+// Setup and run
+//
+void sim_init(void) {
+    memset((void *)sfr, 0, sizeof(sfr));
+    memset(&simStats, 0, sizeof(simStats));
+    memset(simLcd, 0, sizeof(simLcd));
+    simLcdOn=0;
+    memset(simEeprom, 0xFF, sizeof(simEeprom));     // Erased
+    memset(eeWear, 0, sizeof(eeWear));
+    memset((void *)simUsbRam, 0, sizeof(simUsbRam));
+    free(usb.stream);
+    memset(&usb, 0, sizeof(usb));
+    memset(&s, 0, sizeof(s));
+    panel.next=0;
+    panel.pins[0]=panel.pins[1]=0xFF;
+    s.end=NEVER;
+    s.angle=-1;
+    s.random=0x2545F491;
+    s.readingSegment=-1;
+
+    // Power-on reset values
+    sfr[SFR_TRISA]=0xFF;
+    sfr[SFR_TRISB]=0xFF;
+    sfr[SFR_TRISC]=0xFF;
+    sfr[SFR_ANSEL]=0xFF;
+    sfr[SFR_ANSELH]=0x0F;
+    sfr[SFR_T0CON]=0xFF;
+    sfr[SFR_PR2]=0xFF;
+    sfr[SFR_INTCON2]=0xF5;
+    sfr[SFR_INTCON3]=0xC0;
+    sfr[SFR_IPR1]=0x7F;
+    sfr[SFR_IPR2]=0xFE;
+    sfr[SFR_RCON]=0x1C;
+    sfr[SFR_OSCCON]=0x30;
+    s.pubT2con=sfr[SFR_T2CON];
+    s.nextEdge=prof.segments ? NextEdge(0) : NEVER;
+    if (s.nextEdge!=NEVER) SchedulePulses(s.nextEdge, 1);
+}
+
+//
+// Check every flash lands the given angle after the start of a revolution,
+// or after one of the evenly spaced points when there are more flashes
+//
+void sim_expect_angle(double degrees, int flashes) {
+    s.angle=degrees;
+    s.flashes=flashes;
+}
+
+//
+// Check the flashes come at a steady rate, for the strobe running free
+//
+void sim_expect_frequency(double hz) {
+    s.freeHz=hz;
+}
+
+void sim_run(void (*firmware)(void), double seconds) {
+    s.end=(uint64_t)(seconds*SIM_FCY);
+    if (setjmp(s.exit)==0) firmware();
+    Settle();
+}
+
+
+
+//
+// The data EEPROM from and to a file, so the settings can be carried from
+// one run to the next. Loading a file that isn't there leaves it erased.
+// A byte still being written when the run ended is left garbled, as the
+// power going would.
+//
+int sim_eeprom_load(const char *path) {
+    FILE *f=fopen(path, "rb");
+    size_t n;
+    if (!f) return 0;
+    n=fread(simEeprom, 1, sizeof(simEeprom), f);
+    fclose(f);
+    return n==sizeof(simEeprom) ? 0 : -1;
+}
+
+int sim_eeprom_save(const char *path) {
+    FILE *f;
+    size_t n;
+    if (s.eeBusy) {
+        simEeprom[s.eeAddr]=(uint8_t)~s.eeData;
+        s.eeBusy=0;
+    }
+    if (!(f=fopen(path, "wb"))) return -1;
+    n=fwrite(simEeprom, 1, sizeof(simEeprom), f);
+    return fclose(f) || n!=sizeof(simEeprom) ? -1 : 0;
+}
+
+
+
+//
+// Put the cable in at the given seconds and pull it out again at the
+// other, and save what came in on bulk IN when the run is over
+//
+void sim_usb_host(double in, double out) {
+    usb.host=1;
+    usb.plugAt=(uint64_t)(in*SIM_FCY);
+    usb.unplugAt=out>in ? (uint64_t)(out*SIM_FCY) : UINT64_MAX;
+    usb.next=USB_STEP;
+}
+
+int sim_usb_save(const char *path) {
+    FILE *f=fopen(path, "wb");
+    size_t n;
+    if (!f) return -1;
+    n=fwrite(usb.stream, 1, simStats.usbBytes, f);
+    return fclose(f) || n!=simStats.usbBytes ? -1 : 0;
+}
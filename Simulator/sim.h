@@ -0,0 +1,143 @@
+//
+// Cycle counting host simulator for the Stroboman firmware.
+//
+// The firmware is compiled for the host against the fake <xc.h> in this
+// directory. Each SFR access goes through sim_sfr() and every block of
+// plain computation is charged with SIM_CYCLES(), so the simulator knows
+// the instruction cycle count at all times. Timer0/1/2/3, the MSSP, INT1,
+// the interrupt-on-change of port B, idle and sleep, the data EEPROM, the
+// USB engine and the LCD controller are modelled well enough to run the
+// unmodified ISR() and main loop while tach edges are injected from an
+// RPM profile, the knob and buttons are worked at given times and a USB
+// host reads the telemetry.
+//
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+#define SIM_FCY         12000000UL      // Instruction cycles per second
+#define SIM_LCD_PAGES   9
+#define SIM_LCD_COLS    96
+#define SIM_EEPROM_SIZE 256
+#define SIM_EEPROM_WRITE 48000  // Cycles a byte takes to write, 4ms
+#define SIM_USB_RAM     0x200   // Where the USB RAM starts, 256 bytes
+#define SIM_WAKEUP      25024   // Cycles out of sleep, the oscillator start-up timer and the PLL lock, 2.1ms
+
+// Supply current of the PIC18F14K50 at 48MHz and 5V in each mode, mA,
+// rough figures off the datasheet's typical ones for the estimate. The
+// LCD and the LED aren't in it.
+#define SIM_RUN_MA      13.0
+#define SIM_IDLE_MA     5.0
+#define SIM_SLEEP_MA    0.02    // With the brown-out reset on
+
+// Firmware hooks, see Stroboman.X/simhooks.h
+#define SIM_CYCLES(n)   sim_cycles(n)
+#define SIM_EVENT(e)    sim_event(e)
+#define SIM_TRACE(t,v)  sim_trace(t, v)
+#define SIM_USBRAM(a)   (&simUsbRam[(a)-SIM_USB_RAM])
+
+enum {
+    SIM_EV_SAMPLE,      // Main loop has consumed one tach measurement
+    SIM_EV_OVERRUN,     // Tach ring was full, a measurement was dropped
+    SIM_EV_LOOP,        // Main loop has come round again
+    SIM_EV_FRAME,       // Display has been redrawn
+    SIM_EV_INPUT,       // Main loop has taken an input event
+    SIM_EV_COUNT
+};
+
+enum {
+    SIM_TR_PERIOD,      // Revolution period as measured by the firmware, 0 for a stall
+    SIM_TR_FLASH,       // Timebase value the LED should fire at
+    SIM_TR_READING,     // Reading shown, with its range in bits 16 and up
+};
+
+enum {
+    SIM_BUT_UP,
+    SIM_BUT_OK,
+    SIM_BUT_DOWN,
+    SIM_BUT_PUSH,       // The encoder's switch
+};
+
+typedef struct {
+    uint64_t n;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} SimStat;
+
+typedef struct {
+    uint64_t edges;             // Tach edges of the profile
+    uint64_t edgesDropped;      // left out by the noise
+    uint64_t pulses;            // Pulses injected on INT1, the edges with the noise added
+    uint64_t bounces;           // Extra pulses from bouncing
+    uint64_t edgesMerged;       // Pulses that hit an already pending INT1IF
+    uint64_t isrCount;          // Number of ISR invocations
+    SimStat isrCycles;          // Duration of each ISR invocation
+    SimStat int1Latency;        // Tach edge to ISR entry
+    SimStat ledOn;              // LED on-time
+    SimStat ledDelay;           // Last tach edge to LED on
+    SimStat periodError;        // Measured vs. injected revolution period
+    SimStat flashError;         // LED on vs. the time the firmware aimed for
+    SimStat angleError;         // Rotor angle at LED on vs. the one asked for, millidegrees
+    SimStat readingError;       // Reading shown vs. the RPM of the profile, ppm
+    SimStat settle;             // Steady segment start to the reading staying in tolerance
+    uint64_t unsettled;         // Steady segments it never settled in
+    int64_t flashBias;          // Sum of the signed flash errors, late is positive
+    SimStat freeInterval;       // Free running flash interval vs the set one, ns
+    SimStat freeGrid;           // Free running flash vs the ideal one, ns
+    uint64_t freeFirst;         // Cycles of the first and last free running flashes
+    uint64_t freeLast;
+    uint64_t freeFlashes;       // Flash intervals from the first to the last
+    uint64_t ledFlashes;
+    uint64_t flashOnCycles;     // Time the LED was on for the flashes
+    uint64_t spiBytes;
+    uint64_t events[SIM_EV_COUNT];
+    uint64_t mainCycles;        // Cycles spent outside the ISR
+    SimStat loopCycles;         // Time for one pass of the main loop, ISRs included
+    uint64_t busyCycles;        // Main loop time spent on passes that did something
+    uint64_t idleCycles;        // The CPU stopped with the clock running, and coming out of sleep
+    uint64_t sleepCycles;       // The clock stopped
+    uint64_t eeWrites;          // Data EEPROM bytes written
+    uint64_t eeRefused;         // Writes started without the unlock sequence
+    uint32_t eeWear;            // Most writes to any one byte
+    uint64_t usbConfigured;     // Cycle the host had the port open at, 0 if it never did
+    uint64_t usbPackets;        // Bulk IN packets the host took
+    uint64_t usbBytes;
+    uint64_t usbNaks;           // Control transactions the device wasn't ready for
+    uint64_t usbErrors;         // Stalls, wrong data toggles and bad replies
+} SimStats;
+
+volatile uint8_t *sim_sfr(uint8_t addr);
+void sim_cycles(uint32_t n);
+void sim_event(int ev);
+void sim_trace(int id, uint32_t v);
+void sim_sleep(void);
+
+void sim_init(void);
+int sim_load_profile(const char *path, uint8_t edgesPerRev);
+double sim_profile_seconds(void);
+double sim_rpm_at(double seconds);
+void sim_expect_angle(double degrees, int flashes);
+void sim_expect_frequency(double hz);
+int sim_press(double seconds, int button, double ms);
+int sim_turn(double seconds, int detents, double msPerDetent);
+void sim_run(void (*firmware)(void), double seconds);
+int sim_eeprom_load(const char *path);
+int sim_eeprom_save(const char *path);
+void sim_usb_host(double in, double out);
+int sim_usb_save(const char *path);
+
+uint64_t sim_now(void);
+void sim_stat_add(SimStat *s, uint64_t v);
+double sim_stat_avg(const SimStat *s);
+double sim_us(double cycles);
+
+extern SimStats simStats;
+extern uint8_t simLcd[SIM_LCD_PAGES][SIM_LCD_COLS];
+extern uint8_t simLcdOn;        // The display isn't off or in power save
+extern uint8_t simEeprom[SIM_EEPROM_SIZE];
+extern volatile uint8_t simUsbRam[256];
+
+#endif
@@ -0,0 +1,395 @@
+//
+// Command line front end for the Stroboman host simulator
+//
+
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "strobe.h"
+#include "pulse.h"
+#include "input.h"
+#include "settings.h"
+#include "telemetry.h"
+#include "tach.h"
+#include "profile.h"
+
+extern void FirmwareMain(void);
+
+#ifdef PROFILING
+#define PROFOPTS "P:"
+#else
+#define PROFOPTS ""
+#endif
+
+static void Usage(void) {
+    fprintf(stderr,
+        "usage: stroboman-sim [-t seconds] [-e edges/rev] [-p degrees] [-d us] [-n flashes]\n"
+        "                     [-w us] [-u duty] [-f hz] [-r mhz] [-k inputs] [-E file]\n"
+        "                     [-U file[@s[-s]]] [-b log2] [-g log2] [-l] [-m]"
+#ifdef PROFILING
+        " [-P file]"
+#endif
+        " profile\n"
+        "  -t  simulated time, defaults to the length of the profile\n"
+        "  -e  tach edges per revolution (2)\n"
+        "  -p  flash phase angle after the tach edge\n"
+        "  -d  flash delay after the tach edge\n"
+        "  -n  flashes per revolution (1)\n"
+        "  -w  LED on-time, 0 for as long as the duty cycle allows (125)\n"
+        "  -u  average duty cycle limit in 1/1000ths (50)\n"
+        "  -f  flash at this frequency instead of following the tach\n"
+        "  -r  drift, mHz added to the -f frequency\n"
+        "  -k  work the knob and buttons, a comma separated list of seconds:what\n"
+        "      where what is up, ok, down or push, or +n or -n detents, optionally\n"
+        "      followed by @ms for how long the press (100) or each detent (20) takes\n"
+        "  -E  data EEPROM image, loaded before the run if it's there and saved\n"
+        "      after it. Settings saved in it replace the ones given here.\n"
+        "  -U  plug in a USB host that opens the serial port, and save the\n"
+        "      telemetry it reads to file, see ../Telemetry. file@s plugs it in\n"
+        "      s seconds into the run, file@s-s pulls it out again after\n"
+        "  -b  blank out tach edges for 1/2^log2 of a revolution after one, 0 for\n"
+        "      not at all (%d)\n"
+        "  -g  leave out revolutions more than 1/2^log2 off the last one, 0 to\n"
+        "      take them all (%d)\n"
+        "  -l  dump the LCD contents when done\n"
+        "  -m  report as name value lines for scripts instead, see suitediff\n"
+#ifdef PROFILING
+        "  -P  save the firmware's own cycle profile to file as CSV\n"
+#endif
+        , TACH_BLANKLOG2, TACH_GATELOG2);
+    exit(2);
+}
+
+// Cycles the CPU ran for, in the main loop or the ISR
+static double Running(double cycles) {
+    return cycles-simStats.idleCycles-simStats.sleepCycles;
+}
+
+// Average supply current from the time in each mode
+static double Current(double cycles) {
+    return (Running(cycles)*SIM_RUN_MA+simStats.idleCycles*SIM_IDLE_MA
+        +simStats.sleepCycles*SIM_SLEEP_MA)/cycles;
+}
+
+static void PrintStat(const char *name, const SimStat *st) {
+    printf("%-20s %10.2f %10.2f %10.2f us  (n=%llu)\n", name,
+        sim_us(st->min), sim_us(sim_stat_avg(st)), sim_us(st->max),
+        (unsigned long long)st->n);
+}
+
+// Schedule the -k list
+static int Inputs(char *list) {
+    static const char *names[]={ "up", "ok", "down", "push" };
+    for (char *item=strtok(list, ","); item; item=strtok(NULL, ",")) {
+        char *what=strchr(item, ':'), *p;
+        double at=atof(item), ms=0;
+        int b, err=-1;
+        if (!what) return -1;
+        what++;
+        if ((p=strchr(what, '@'))) {
+            *p=0;
+            ms=atof(p+1);
+        }
+        for (b=0; b<4; b++) {
+            if (!strcmp(what, names[b])) err=sim_press(at, b, ms ? ms : 100);
+        }
+        if (what[0]=='+' || what[0]=='-') err=sim_turn(at, atoi(what), ms ? ms : 20);
+        if (err) return -1;
+    }
+    return 0;
+}
+
+#ifdef PROFILING
+static const char *const slotNames[PROFILE_SLOTS]={
+    "isr", "timer1", "timer0", "int1", "timer2", "loop", "frame", "pump",
+};
+
+// What the firmware timed itself, next to what the simulator saw
+static void PrintProfile(void) {
+    printf("%-20s %10s %10s %10s\n", "firmware profile", "min", "max", "n");
+    for (int slot=0; slot<PROFILE_SLOTS; slot++) {
+        const volatile t_profile *p=ProfileGet((uint8_t)slot);
+        unsigned long n=0;
+        for (int b=0; b<PROFILE_BUCKETS; b++) n+=p->count[b];
+        if (!n) continue;
+        printf("  %-18s %10.2f %10.2f %10lu us\n", slotNames[slot], sim_us(p->min), sim_us(p->max), n);
+    }
+    printf("%-20s %u collided, %u chained\n", "", ProfileCollided(), ProfileChained());
+}
+
+// One line a slot: its name, min and max in ticks and then the buckets
+static int SaveProfile(const char *name) {
+    FILE *f=fopen(name, "w");
+    if (!f) return -1;
+    fprintf(f, "slot,min,max");
+    for (int b=0; b<PROFILE_BUCKETS; b++) fprintf(f, ",lt%u", 1u<<(PROFILE_FIRSTLOG2+b));
+    fprintf(f, "\n");
+    for (int slot=0; slot<PROFILE_SLOTS; slot++) {
+        const volatile t_profile *p=ProfileGet((uint8_t)slot);
+        fprintf(f, "%s,%u,%u", slotNames[slot], p->min==0xFFFF ? 0 : p->min, p->max);
+        for (int b=0; b<PROFILE_BUCKETS; b++) fprintf(f, ",%u", p->count[b]);
+        fprintf(f, "\n");
+    }
+    fprintf(f, "collided,%u\nchained,%u\n", ProfileCollided(), ProfileChained());
+    return fclose(f) ? -1 : 0;
+}
+#endif
+
+//
+// The results as a line each, a name and a number, for make suite to
+// collect and suitediff to compare. Statistics with nothing in them are
+// left out. Apart from the counts of what was injected and of what the
+// tach filter threw out, lower is better.
+//
+static void Value(const char *name, double v) {
+    printf("%s %.3f\n", name, v);
+}
+
+static void Stat(const char *name, const SimStat *st, double scale) {
+    char key[64];
+    if (!st->n) return;
+    snprintf(key, sizeof(key), "%s_avg", name);
+    Value(key, sim_stat_avg(st)*scale);
+    snprintf(key, sizeof(key), "%s_max", name);
+    Value(key, st->max*scale);
+}
+
+static void Machine(double seconds, uint64_t revs) {
+    double cycles=seconds*SIM_FCY, us=1e6/SIM_FCY;
+    uint64_t samples=simStats.events[SIM_EV_SAMPLE];
+
+    Value("seconds", seconds);
+    Value("edges", simStats.edges);
+    Value("pulses", simStats.pulses);
+    Value("revolutions", revs);
+    Value("samples", samples);
+    Value("samples_missed", revs>samples ? revs-samples : 0);
+    Value("edges_merged", simStats.edgesMerged);
+    Value("overruns", simStats.events[SIM_EV_OVERRUN]);
+    Value("edges_blanked", TachBlanked());
+    Value("revolutions_rejected", TachRejected());
+    Value("isr_cpu_pct", 100.0*(Running(cycles)-simStats.mainCycles)/cycles);
+    Value("loop_busy_pct", 100.0*simStats.busyCycles/cycles);
+    Value("run_pct", 100.0*Running(cycles)/cycles);
+    Value("current_ma", Current(cycles));
+    Stat("isr_us", &simStats.isrCycles, us);
+    Stat("int1_latency_us", &simStats.int1Latency, us);
+    Stat("loop_us", &simStats.loopCycles, us);
+    Stat("period_error_us", &simStats.periodError, us);
+    Stat("flash_error_us", &simStats.flashError, us);
+    Stat("angle_error_deg", &simStats.angleError, 0.001);
+    Stat("reading_error_pct", &simStats.readingError, 1e-4);
+    Stat("settle_ms", &simStats.settle, us/1000);
+    if (simStats.settle.n || simStats.unsettled) Value("unsettled", simStats.unsettled);
+}
+
+static void DumpLcd(void) {
+    if (!simLcdOn) printf("The display is off, it would show:\n");
+    for (int page=0; page<SIM_LCD_PAGES; page++) {
+        for (int bit=0; bit<8; bit++) {
+            for (int col=0; col<SIM_LCD_COLS; col++) {
+                putchar((simLcd[page][col]>>bit)&1 ? '#' : '.');
+            }
+            putchar('\n');
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    double seconds=0;
+    int edgesPerRev=2;
+    int dumpLcd=0;
+    int machine=0;
+    int blank=TACH_BLANKLOG2, gate=TACH_GATELOG2;
+    char *inputs=NULL;
+    char *eeprom=NULL;
+    char *telemetry=NULL;
+    double plugIn=0, plugOut=0;
+#ifdef PROFILING
+    char *profile=NULL;
+#endif
+    double hz=0;
+    int drift=0;
+    int phase=0, delay=0, flashes=1;
+    int width=PULSE_WIDTH, duty=PULSE_DUTY;
+    int opt;
+    char *p;
+
+    while ((opt=getopt(argc, argv, "t:e:p:d:n:w:u:f:r:k:E:U:b:g:lm" PROFOPTS))!=-1) {
+        switch (opt) {
+            case 't': seconds=atof(optarg); break;
+            case 'e': edgesPerRev=atoi(optarg); break;
+            case 'p': phase=atoi(optarg); break;
+            case 'd': delay=atoi(optarg); break;
+            case 'n': flashes=atoi(optarg); break;
+            case 'w': width=atoi(optarg); break;
+            case 'u': duty=atoi(optarg); break;
+            case 'f': hz=atof(optarg); break;
+            case 'r': drift=atoi(optarg); break;
+            case 'k': inputs=optarg; break;
+            case 'E': eeprom=optarg; break;
+            case 'U':
+                telemetry=optarg;
+                if ((p=strchr(optarg, '@'))) {
+                    *p++=0;
+                    plugIn=strtod(p, &p);
+                    if (*p=='-') plugOut=atof(p+1);
+                }
+                break;
+            case 'b': blank=atoi(optarg); break;
+            case 'g': gate=atoi(optarg); break;
+            case 'l': dumpLcd=1; break;
+            case 'm': machine=1; break;
+#ifdef PROFILING
+            case 'P': profile=optarg; break;
+#endif
+            default: Usage();
+        }
+    }
+    if (optind!=argc-1 || edgesPerRev<1 || flashes<1 || flashes>STROBE_MAXFLASHES
+            || blank<0 || blank>8 || gate<0 || gate>8) Usage();
+    if (sim_load_profile(argv[optind], (uint8_t)edgesPerRev)) {
+        fprintf(stderr, "stroboman-sim: can't load profile %s\n", argv[optind]);
+        return 1;
+    }
+    if (seconds<=0) seconds=sim_profile_seconds();
+
+    sim_init();
+    if (inputs && Inputs(inputs)) Usage();
+    if (eeprom && sim_eeprom_load(eeprom)) {
+        fprintf(stderr, "stroboman-sim: can't load EEPROM image %s\n", eeprom);
+        return 1;
+    }
+    if (telemetry) sim_usb_host(plugIn, plugOut);
+    StrobeSetPhase((uint16_t)phase);
+    StrobeSetDelay((uint16_t)delay);
+    StrobeSetFlashes((uint8_t)flashes);
+    PulseSetWidth((uint16_t)width);
+    PulseSetDuty((uint16_t)duty);
+    StrobeSetDrift((int16_t)drift);
+    TachSetFilter((uint8_t)blank, (uint8_t)gate);
+    StrobeSetFrequency((uint32_t)llround(hz*1000));
+    if (hz) {
+        // The drift is on top of the frequency, within the same range
+        double mhz=fmin(fmax(llround(hz*1000)+drift, STROBE_MINMHZ), STROBE_MAXMHZ);
+        sim_expect_frequency(mhz/1000);
+    } else if (!delay) {
+        // A fixed delay isn't an angle, only the phase can be checked
+        sim_expect_angle(phase%360, flashes);
+    }
+    sim_run(FirmwareMain, seconds);
+    if (eeprom && sim_eeprom_save(eeprom)) {
+        fprintf(stderr, "stroboman-sim: can't save EEPROM image %s\n", eeprom);
+        return 1;
+    }
+    if (telemetry && sim_usb_save(telemetry)) {
+        fprintf(stderr, "stroboman-sim: can't save telemetry %s\n", telemetry);
+        return 1;
+    }
+#ifdef PROFILING
+    if (profile && SaveProfile(profile)) {
+        fprintf(stderr, "stroboman-sim: can't save the profile %s\n", profile);
+        return 1;
+    }
+#endif
+
+    double cycles=seconds*SIM_FCY;
+    uint64_t revs=simStats.edges/edgesPerRev;
+    if (machine) {
+        Machine(seconds, revs);
+        return 0;
+    }
+    printf("%-20s %s, %.3f s\n", "profile", argv[optind], seconds);
+    printf("%-20s %llu (%llu merged)\n", "tach edges",
+        (unsigned long long)simStats.edges, (unsigned long long)simStats.edgesMerged);
+    if (simStats.pulses!=simStats.edges || simStats.edgesDropped) {
+        printf("%-20s %llu pulses on INT1, %llu edges left out, %llu bounces\n", "tach noise",
+            (unsigned long long)simStats.pulses, (unsigned long long)simStats.edgesDropped,
+            (unsigned long long)simStats.bounces);
+    }
+    printf("%-20s %llu\n", "revolutions", (unsigned long long)revs);
+    printf("%-20s %llu (%llu dropped)\n", "samples processed",
+        (unsigned long long)simStats.events[SIM_EV_SAMPLE],
+        (unsigned long long)(revs>simStats.events[SIM_EV_SAMPLE] ? revs-simStats.events[SIM_EV_SAMPLE] : 0));
+    printf("%-20s %llu\n", "ring overruns", (unsigned long long)simStats.events[SIM_EV_OVERRUN]);
+    printf("%-20s %u edges blanked out, %u revolutions left out\n", "tach filter",
+        TachBlanked(), TachRejected());
+    printf("%-20s %llu, %.1f%% of the CPU\n", "ISR calls",
+        (unsigned long long)simStats.isrCount, 100.0*(Running(cycles)-simStats.mainCycles)/cycles);
+    printf("%-20s %.1f%% of the CPU\n", "main loop busy", 100.0*simStats.busyCycles/cycles);
+    printf("%-20s run %.1f%%, idle %.1f%%, asleep %.1f%% of the time, %.2f mA on average\n", "power",
+        100.0*Running(cycles)/cycles, 100.0*simStats.idleCycles/cycles,
+        100.0*simStats.sleepCycles/cycles, Current(cycles));
+    printf("%-20s %llu\n", "display frames", (unsigned long long)simStats.events[SIM_EV_FRAME]);
+    printf("%-20s %llu bytes\n", "SPI traffic", (unsigned long long)simStats.spiBytes);
+    printf("%-20s %u saved, %llu bytes written (%llu refused), at most %u to a byte\n",
+        "settings", SettingsGetSaves(), (unsigned long long)simStats.eeWrites,
+        (unsigned long long)simStats.eeRefused, simStats.eeWear);
+    printf("%-20s last run %lu to %lu RPM, peak %lu RPM\n", "",
+        (unsigned long)SettingsGetMin(), (unsigned long)SettingsGetMax(), (unsigned long)SettingsGetPeak());
+    if (telemetry && simStats.usbConfigured) {
+        printf("%-20s port open at %.1f ms, %llu packets, %llu bytes, %u records dropped\n",
+            "USB telemetry", sim_us(simStats.usbConfigured)/1000, (unsigned long long)simStats.usbPackets,
+            (unsigned long long)simStats.usbBytes, TelemetryDropped());
+        printf("%-20s %llu NAKs, %llu errors\n", "",
+            (unsigned long long)simStats.usbNaks, (unsigned long long)simStats.usbErrors);
+    } else if (telemetry) {
+        printf("%-20s never enumerated, %llu NAKs, %llu errors\n", "USB telemetry",
+            (unsigned long long)simStats.usbNaks, (unsigned long long)simStats.usbErrors);
+    }
+    if (inputs) {
+        printf("%-20s %llu (%u dropped)\n", "input events",
+            (unsigned long long)simStats.events[SIM_EV_INPUT], InputDropped());
+        printf("%-20s phase %u, delay %u us, %u flashes, width %u us\n", "settings",
+            StrobeGetPhase(), StrobeGetDelay(), StrobeGetFlashes(), PulseGetWidth());
+        printf("%-20s frequency %.3f Hz, drift %d mHz\n", "",
+            StrobeGetFrequency()/1000.0, StrobeGetDrift());
+    }
+    printf("%-20s %10s %10s %10s\n", "", "min", "avg", "max");
+    PrintStat("ISR duration", &simStats.isrCycles);
+    PrintStat("INT1 latency", &simStats.int1Latency);
+    PrintStat("main loop pass", &simStats.loopCycles);
+    PrintStat("LED on-time", &simStats.ledOn);
+    printf("%-20s %10.2f %% of the time\n", "LED duty cycle", 100.0*simStats.flashOnCycles/cycles);
+    PrintStat("edge to LED on", &simStats.ledDelay);
+    PrintStat("period error", &simStats.periodError);
+    PrintStat("flash error", &simStats.flashError);
+    if (simStats.flashError.n) {
+        printf("%-20s %10.2f us late on average\n", "flash bias",
+            sim_us((double)simStats.flashBias/simStats.flashError.n));
+    }
+    if (simStats.freeGrid.n) {
+        const SimStat *g=&simStats.freeGrid, *iv=&simStats.freeInterval;
+        double want=(double)llround(fmin(fmax(llround(hz*1000)+drift, STROBE_MINMHZ), STROBE_MAXMHZ))/1000;
+        double got=simStats.freeFlashes*(double)SIM_FCY/(simStats.freeLast-simStats.freeFirst);
+        printf("%-20s %.6f Hz for %.6f Hz, %+.6f Hz (%+.3f ppm)\n", "flash rate",
+            got, want, got-want, (got-want)/want*1e6);
+        printf("%-20s %10.0f %10.1f %10.0f ns (n=%llu)\n", "interval jitter",
+            (double)iv->min, sim_stat_avg(iv), (double)iv->max, (unsigned long long)iv->n);
+        printf("%-20s %10.0f %10.1f %10.0f ns (n=%llu)\n", "off the ideal grid",
+            (double)g->min, sim_stat_avg(g), (double)g->max, (unsigned long long)g->n);
+    }
+    if (simStats.angleError.n) {
+        const SimStat *a=&simStats.angleError;
+        printf("%-20s %10.3f %10.3f %10.3f deg (n=%llu)\n", "angle error",
+            a->min/1000.0, sim_stat_avg(a)/1000.0, a->max/1000.0, (unsigned long long)a->n);
+    }
+    if (simStats.readingError.n) {
+        const SimStat *r=&simStats.readingError;
+        printf("%-20s %10.3f %10.3f %10.3f %%  (n=%llu)\n", "reading error",
+            r->min/1e4, sim_stat_avg(r)/1e4, r->max/1e4, (unsigned long long)r->n);
+    }
+    if (simStats.settle.n || simStats.unsettled) {
+        printf("%-20s %10.1f ms at most, %llu steady segments never did\n", "reading settled",
+            sim_us(simStats.settle.max)/1000, (unsigned long long)simStats.unsettled);
+    }
+#ifdef PROFILING
+    PrintProfile();
+#endif
+    if (dumpLcd) DumpLcd();
+    return 0;
+}
@@ -0,0 +1,130 @@
+//
+// Compares two runs of make suite, each a file of lines
+//
+//   <profile> <name> <value>
+//
+// as stroboman-sim -m gives them with the profile in front. Every result
+// that changed is listed with how much by, and one that got worse by more
+// than the tolerance fails the comparison. Apart from the counts of what
+// the profile put in and of what the tach filter threw out, which only
+// tell the runs apart, lower is better.
+//
+//   suitediff [-t percent] [-v] base new
+//
+// -t sets the tolerance, 5% when not given, -v lists the results that
+// didn't change as well. The exit status is 1 when anything got worse.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAXRESULTS  1024
+
+typedef struct {
+    char profile[32];
+    char name[32];
+    double value;
+} Result;
+
+typedef struct {
+    Result r[MAXRESULTS];
+    int n;
+} Run;
+
+// What the profile put in and the filter threw out, not how the firmware did
+static const char *const inputs[]={
+    "seconds", "edges", "pulses", "revolutions", "samples",
+    "edges_blanked", "revolutions_rejected",
+};
+
+static Run base, now;
+
+
+
+static int Load(const char *path, Run *run) {
+    char line[256];
+    FILE *f=fopen(path, "r");
+    if (!f) return -1;
+    run->n=0;
+    while (fgets(line, sizeof(line), f)) {
+        Result *r=&run->r[run->n];
+        if (sscanf(line, "%31s %31s %lf", r->profile, r->name, &r->value)!=3) continue;
+        if (++run->n>=MAXRESULTS) break;
+    }
+    fclose(f);
+    return 0;
+}
+
+static const Result *Find(const Run *run, const Result *like) {
+    for (int i=0; i<run->n; i++) {
+        if (!strcmp(run->r[i].profile, like->profile) && !strcmp(run->r[i].name, like->name)) {
+            return &run->r[i];
+        }
+    }
+    return NULL;
+}
+
+static int IsInput(const char *name) {
+    for (size_t i=0; i<sizeof(inputs)/sizeof(inputs[0]); i++) {
+        if (!strcmp(inputs[i], name)) return 1;
+    }
+    return 0;
+}
+
+
+
+int main(int argc, char **argv) {
+    double tolerance=5;
+    int verbose=0, opt, worse=0;
+
+    while ((opt=getopt(argc, argv, "t:v"))!=-1) {
+        switch (opt) {
+            case 't': tolerance=atof(optarg); break;
+            case 'v': verbose=1; break;
+            default: optind=argc;
+        }
+    }
+    if (optind!=argc-2) {
+        fprintf(stderr, "usage: suitediff [-t percent] [-v] base new\n");
+        return 2;
+    }
+    for (int i=0; i<2; i++) {
+        if (Load(argv[optind+i], i ? &now : &base)) {
+            fprintf(stderr, "suitediff: can't read %s\n", argv[optind+i]);
+            return 2;
+        }
+    }
+
+    printf("%-12s %-24s %12s %12s %9s\n", "profile", "result", "base", "new", "change");
+    for (int i=0; i<now.n; i++) {
+        const Result *n=&now.r[i], *b=Find(&base, n);
+        const char *verdict="";
+        if (!b) {
+            printf("%-12s %-24s %12s %12.3f %9s\n", n->profile, n->name, "-", n->value, "new");
+            continue;
+        }
+        if (n->value==b->value && !verbose) continue;
+        if (!IsInput(n->name) && n->value>b->value+fabs(b->value)*tolerance/100) {
+            verdict="  WORSE";
+            worse++;
+        }
+        if (b->value) {
+            printf("%-12s %-24s %12.3f %12.3f %+8.1f%%%s\n", n->profile, n->name,
+                b->value, n->value, (n->value-b->value)/fabs(b->value)*100, verdict);
+        } else {
+            printf("%-12s %-24s %12.3f %12.3f %9s%s\n", n->profile, n->name,
+                b->value, n->value, "", verdict);
+        }
+    }
+    for (int i=0; i<base.n; i++) {
+        if (!Find(&now, &base.r[i])) {
+            printf("%-12s %-24s %12.3f %12s %9s\n", base.r[i].profile, base.r[i].name,
+                base.r[i].value, "-", "gone");
+        }
+    }
+    printf("%d worse by more than %g%%\n", worse, tolerance);
+    return worse ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+//
+// Host stand-in for the XC8 <xc.h> device header of the PIC18F14K50.
+//
+// Every SFR name expands to an access through sim_sfr() so the simulator
+// can charge a cycle for it, bring the peripherals up to date and raise
+// any interrupt that became due before the firmware sees the register.
+// Only the registers and bits used by the firmware are defined here.
+//
+
+#ifndef XC_H
+#define XC_H
+
+#include <stdint.h>
+#include "sfr.h"
+#include "sim.h"
+#include "cost.h"
+
+// XC8 keywords and builtins
+#define interrupt
+#define low_priority
+#define NOP()           SIM_CYCLES(1)
+#define CLRWDT()        SIM_CYCLES(1)
+#define SLEEP()         sim_sleep()
+
+#define SFR(a)          (*sim_sfr(a))
+#define SFRBITS(t,a)    (*(volatile t *)sim_sfr(a))
+
+#define UEP0            SFR(SFR_UEP0)
+#define UEP1            SFR(SFR_UEP1)
+#define UEP2            SFR(SFR_UEP2)
+#define UADDR           SFR(SFR_UADDR)
+#define UFRML           SFR(SFR_UFRML)
+#define UFRMH           SFR(SFR_UFRMH)
+#define UIE             SFR(SFR_UIE)
+#define UCFG            SFR(SFR_UCFG)
+#define UIR             SFR(SFR_UIR)
+#define USTAT           SFR(SFR_USTAT)
+#define UCON            SFR(SFR_UCON)
+#define WPUB            SFR(SFR_WPUB)
+#define IOCB            SFR(SFR_IOCB)
+#define ANSEL           SFR(SFR_ANSEL)
+#define ANSELH          SFR(SFR_ANSELH)
+#define PORTA           SFR(SFR_PORTA)
+#define PORTB           SFR(SFR_PORTB)
+#define PORTC           SFR(SFR_PORTC)
+#define LATA            SFR(SFR_LATA)
+#define LATB            SFR(SFR_LATB)
+#define LATC            SFR(SFR_LATC)
+#define TRISA           SFR(SFR_TRISA)
+#define TRISB           SFR(SFR_TRISB)
+#define TRISC           SFR(SFR_TRISC)
+#define PIE1            SFR(SFR_PIE1)
+#define PIR1            SFR(SFR_PIR1)
+#define IPR1            SFR(SFR_IPR1)
+#define PIE2            SFR(SFR_PIE2)
+#define PIR2            SFR(SFR_PIR2)
+#define IPR2            SFR(SFR_IPR2)
+#define EECON1          SFR(SFR_EECON1)
+#define EECON2          SFR(SFR_EECON2)
+#define EEDATA          SFR(SFR_EEDATA)
+#define EEADR           SFR(SFR_EEADR)
+#define T3CON           SFR(SFR_T3CON)
+#define TMR3L           SFR(SFR_TMR3L)
+#define TMR3H           SFR(SFR_TMR3H)
+#define SSPCON1         SFR(SFR_SSPCON1)
+#define SSPSTAT         SFR(SFR_SSPSTAT)
+#define SSPBUF          SFR(SFR_SSPBUF)
+#define T2CON           SFR(SFR_T2CON)
+#define PR2             SFR(SFR_PR2)
+#define TMR2            SFR(SFR_TMR2)
+#define T1CON           SFR(SFR_T1CON)
+#define TMR1L           SFR(SFR_TMR1L)
+#define TMR1H           SFR(SFR_TMR1H)
+#define RCON            SFR(SFR_RCON)
+#define OSCCON          SFR(SFR_OSCCON)
+#define T0CON           SFR(SFR_T0CON)
+#define TMR0L           SFR(SFR_TMR0L)
+#define TMR0H           SFR(SFR_TMR0H)
+#define INTCON3         SFR(SFR_INTCON3)
+#define INTCON2         SFR(SFR_INTCON2)
+#define INTCON          SFR(SFR_INTCON)
+
+#define UCONbits        SFRBITS(UCONbits_t, SFR_UCON)
+#define UCFGbits        SFRBITS(UCFGbits_t, SFR_UCFG)
+#define USTATbits       SFRBITS(USTATbits_t, SFR_USTAT)
+#define UIRbits         SFRBITS(UIRbits_t, SFR_UIR)
+#define PORTAbits       SFRBITS(PORTAbits_t, SFR_PORTA)
+#define PORTBbits       SFRBITS(PORTBbits_t, SFR_PORTB)
+#define PORTCbits       SFRBITS(PORTCbits_t, SFR_PORTC)
+#define LATBbits        SFRBITS(LATBbits_t, SFR_LATB)
+#define LATCbits        SFRBITS(LATCbits_t, SFR_LATC)
+#define TRISBbits       SFRBITS(TRISBbits_t, SFR_TRISB)
+#define TRISCbits       SFRBITS(TRISCbits_t, SFR_TRISC)
+#define PIR1bits        SFRBITS(PIR1bits_t, SFR_PIR1)
+#define PIE1bits        SFRBITS(PIE1bits_t, SFR_PIE1)
+#define IPR1bits        SFRBITS(IPR1bits_t, SFR_IPR1)
+#define PIR2bits        SFRBITS(PIR2bits_t, SFR_PIR2)
+#define PIE2bits        SFRBITS(PIE2bits_t, SFR_PIE2)
+#define IPR2bits        SFRBITS(IPR2bits_t, SFR_IPR2)
+#define EECON1bits      SFRBITS(EECON1bits_t, SFR_EECON1)
+#define T3CONbits       SFRBITS(T3CONbits_t, SFR_T3CON)
+#define SSPCON1bits     SFRBITS(SSPCON1bits_t, SFR_SSPCON1)
+#define SSPSTATbits     SFRBITS(SSPSTATbits_t, SFR_SSPSTAT)
+#define T2CONbits       SFRBITS(T2CONbits_t, SFR_T2CON)
+#define T1CONbits       SFRBITS(T1CONbits_t, SFR_T1CON)
+#define RCONbits        SFRBITS(RCONbits_t, SFR_RCON)
+#define OSCCONbits      SFRBITS(OSCCONbits_t, SFR_OSCCON)
+#define T0CONbits       SFRBITS(T0CONbits_t, SFR_T0CON)
+#define INTCON3bits     SFRBITS(INTCON3bits_t, SFR_INTCON3)
+#define INTCON2bits     SFRBITS(INTCON2bits_t, SFR_INTCON2)
+#define INTCONbits      SFRBITS(INTCONbits_t, SFR_INTCON)
+
+// Bare bit names, as the legacy XC8 headers provide them
+#define GIE             INTCONbits.GIE
+#define PEIE            INTCONbits.PEIE
+#define TMR0IE          INTCONbits.TMR0IE
+#define TMR0IF          INTCONbits.TMR0IF
+#define RABIE           INTCONbits.RABIE
+#define RABIF           INTCONbits.RABIF
+#define INT1IE          INTCON3bits.INT1IE
+#define INT1IF          INTCON3bits.INT1IF
+#define INT1IP          INTCON3bits.INT1IP
+#define INTEDG1         INTCON2bits.INTEDG1
+#define TMR0IP          INTCON2bits.TMR0IP
+#define IPEN            RCONbits.IPEN
+#define TMR0ON          T0CONbits.TMR0ON
+#define T08BIT          T0CONbits.T08BIT
+#define T0CS            T0CONbits.T0CS
+#define PSA             T0CONbits.PSA
+#define TMR1IE          PIE1bits.TMR1IE
+#define TMR1IF          PIR1bits.TMR1IF
+#define TMR1IP          IPR1bits.TMR1IP
+#define TMR2IE          PIE1bits.TMR2IE
+#define TMR2IF          PIR1bits.TMR2IF
+#define TMR2IP          IPR1bits.TMR2IP
+#define SSPIE           PIE1bits.SSPIE
+#define SSPIF           PIR1bits.SSPIF
+#define TMR3IE          PIE2bits.TMR3IE
+#define TMR3IF          PIR2bits.TMR3IF
+#define TMR3IP          IPR2bits.TMR3IP
+#define USBIE           PIE2bits.USBIE
+#define USBIF           PIR2bits.USBIF
+#define TMR1ON          T1CONbits.TMR1ON
+#define TMR1CS          T1CONbits.TMR1CS
+#define T1OSCEN         T1CONbits.T1OSCEN
+#define T1SYNC          T1CONbits.nT1SYNC
+#define TMR2ON          T2CONbits.TMR2ON
+#define TMR3ON          T3CONbits.TMR3ON
+#define TMR3CS          T3CONbits.TMR3CS
+
+// Single bits out of multi-bit fields
+#define T1CKPS0         SFRBITS(SIM_T1CKPSbits_t, SFR_T1CON).B0
+#define T1CKPS1         SFRBITS(SIM_T1CKPSbits_t, SFR_T1CON).B1
+#define T2CKPS0         SFRBITS(SIM_T2CKPSbits_t, SFR_T2CON).B0
+#define T2CKPS1         SFRBITS(SIM_T2CKPSbits_t, SFR_T2CON).B1
+
+#endif
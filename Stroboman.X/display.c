@@ -0,0 +1,120 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "rpm.h"
+#include "format.h"
+#include "display.h"
+
+//
+// The tach can come round thousands of times a second, far faster than
+// the LCD can show or anyone can read, so the display gets redrawn at a
+// fixed frame rate instead with whatever the latest reading is by then.
+// The frames are timed on Timer0, adding up the ticks between calls so
+// only its low 16 bits are needed; the main loop comes round far more
+// often than Timer0 wraps.
+//
+// The RPM shown only follows the reading once it has moved more than the
+// hysteresis away from it, so a reading that sits between two values
+// doesn't make the last digit flicker. The reading comes in the units of
+// its range, so the hysteresis is in those too and stays about the same
+// fraction of it whichever range it's in.
+//
+
+// The big digits have room for five characters, the point is one of them
+static const uint8_t formats[RPM_RANGES]={
+    FORMAT_DIGITS(4)|FORMAT_DECIMALS(3),
+    FORMAT_DIGITS(4)|FORMAT_DECIMALS(2)|FORMAT_BLANK,
+    FORMAT_DIGITS(4)|FORMAT_DECIMALS(1)|FORMAT_BLANK,
+    FORMAT_DIGITS(5)|FORMAT_BLANK,
+    FORMAT_DIGITS(4)|FORMAT_DECIMALS(1)|FORMAT_BLANK,
+};
+
+static uint8_t rate=DISPLAY_HZ;
+static uint32_t frame=TACH_CLOCK/DISPLAY_HZ;    // Timer0 ticks per frame
+static uint16_t hysteresis=DISPLAY_HYSTERESIS;
+
+static uint16_t last;
+static uint32_t elapsed=TACH_CLOCK;     // First frame right away
+static uint16_t shown;
+static uint8_t shownRange=RPM_UNITS;
+
+
+
+//
+// Set the frames per second
+//
+void DisplaySetRate(uint8_t hz) {
+    if (hz<1) hz=1;
+    if (hz>DISPLAY_MAXHZ) hz=DISPLAY_MAXHZ;
+    rate=hz;
+    frame=TACH_CLOCK/hz;
+    SIM_CYCLES(CY_UDIV32);
+}
+
+
+
+//
+// Set how far the reading has to move from the RPM shown to be shown, 0
+// shows every change
+//
+void DisplaySetHysteresis(uint16_t rpm) {
+    hysteresis=rpm;
+}
+
+
+
+uint8_t DisplayGetRate(void) {
+    return rate;
+}
+
+uint16_t DisplayGetHysteresis(void) {
+    return hysteresis;
+}
+
+
+
+//
+// Called from the main loop, returns 1 when it's time for the next frame
+//
+uint8_t DisplayDue(void) {
+    uint16_t now;
+
+    now=TMR0L;
+    now|=(uint16_t)TMR0H<<8;    // Latched when TMR0L was read
+    elapsed+=(uint16_t)(now-last);
+    last=now;
+    SIM_CYCLES(CY_CALL+CY_ADD32*2+8);
+    if (elapsed<frame) return 0;
+    // Frames that were missed are dropped, not caught up with
+    elapsed=elapsed<2*frame ? elapsed-frame : 0;
+    SIM_CYCLES(CY_ADD32*2);
+    return 1;
+}
+
+
+
+//
+// The reading to show for the latest one, in the units of range
+//
+uint16_t DisplayRpm(uint16_t reading, uint8_t range) {
+    uint16_t diff;
+
+    diff=reading>shown ? reading-shown : shown-reading;
+    // Stopped or another range is always shown
+    if (diff>hysteresis || !reading || range!=shownRange) {
+        shown=reading;
+        shownRange=range;
+    }
+    SIM_CYCLES(CY_CALL+16);
+    return shown;
+}
+
+
+
+//
+// How to format a reading in range for the big digits
+//
+uint8_t DisplayFormat(uint8_t range) {
+    SIM_CYCLES(CY_CALL+CY_TBLRD);
+    return formats[range];
+}
@@ -0,0 +1,22 @@
+//
+// When to redraw the display and what RPM to show
+//
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdint.h>
+
+#define DISPLAY_HZ          8       // Default frames per second
+#define DISPLAY_MAXHZ       50
+#define DISPLAY_HYSTERESIS  2       // Default the reading may wander by unshown, in its units
+
+void DisplaySetRate(uint8_t hz);
+void DisplaySetHysteresis(uint16_t rpm);
+uint8_t DisplayGetRate(void);
+uint16_t DisplayGetHysteresis(void);
+uint8_t DisplayDue(void);
+uint16_t DisplayRpm(uint16_t reading, uint8_t range);
+uint8_t DisplayFormat(uint8_t range);
+
+#endif
@@ -0,0 +1,118 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "filter.h"
+
+//
+// All the filters keep their state incrementally so that adding a sample
+// costs the same no matter how long the window is. The boxcar keeps a
+// running sum, adding the new sample and subtracting the one falling out
+// of the window, and divides by shifting. The first sample after a reset
+// primes the window so the output is valid right away, only the part of
+// it in use so that a long window costs no more than a short one. The
+// median keeps its last few samples at the start of the same window.
+//
+
+static uint8_t mode;
+static uint8_t length;
+static uint8_t primed;
+
+static uint16_t window[1<<FILTER_MAXLOG2];
+static uint8_t pos;
+static uint32_t total;
+
+static uint16_t spike[3];
+
+
+
+//
+// Select the filter and its length, see filter.h
+//
+void FilterSetup(uint8_t newMode, uint8_t newLength) {
+    if ((newMode&~FILTER_DESPIKE)==FILTER_MEDIAN) {
+        if (newLength>FILTER_MAXMEDIAN) newLength=FILTER_MAXMEDIAN;
+        newLength|=1;
+    } else if (newLength>FILTER_MAXLOG2) {
+        newLength=FILTER_MAXLOG2;
+    }
+    mode=newMode;
+    length=newLength;
+    FilterReset();
+}
+
+
+
+//
+// Forget the history, the next sample primes the filter again
+//
+void FilterReset(void) {
+    primed=0;
+}
+
+
+
+//
+// Median of the first n entries in buf, n is odd and at most 5
+//
+static uint16_t Median(uint16_t *buf, uint8_t n) {
+    uint16_t s[FILTER_MAXMEDIAN];
+    uint16_t v;
+    uint8_t i, j;
+
+    for (i=0; i<n; i++) {
+        v=buf[i];
+        for (j=i; j>0 && s[j-1]>v; j--) s[j]=s[j-1];
+        s[j]=v;
+    }
+    SIM_CYCLES(n*n*12);
+    return s[n>>1];
+}
+
+
+
+//
+// Feed one sample through the selected filter and return its output
+//
+uint16_t FilterAdd(uint16_t sample) {
+    uint8_t i;
+
+    SIM_CYCLES(CY_CALL+6);
+    if (!primed) {
+        for (i=0; i<3; i++) spike[i]=sample;
+        for (i=0; i<(uint8_t)(1<<length) || i<FILTER_MAXMEDIAN; i++) window[i]=sample;
+        total=(uint32_t)sample<<length;
+        pos=0;
+        primed=1;
+        SIM_CYCLES((i+3)*6);
+    }
+
+    if (mode&FILTER_DESPIKE) {
+        spike[0]=spike[1];
+        spike[1]=spike[2];
+        spike[2]=sample;
+        sample=Median(spike, 3);
+    }
+
+    switch (mode&~FILTER_DESPIKE) {
+        case FILTER_IIR:
+            // total holds the average scaled up by 2^length
+            total-=total>>length;
+            total+=sample;
+            SIM_CYCLES(2*CY_ADD32+length*CY_SHIFT32);
+            return (uint16_t)(total>>length);
+
+        case FILTER_MEDIAN:
+            for (i=FILTER_MAXMEDIAN-1; i>0; i--) window[i]=window[i-1];
+            window[0]=sample;
+            SIM_CYCLES(FILTER_MAXMEDIAN*6);
+            return Median(window, length);
+
+        default:
+            total-=window[pos];
+            total+=sample;
+            window[pos]=sample;
+            pos=(pos+1)&((1<<length)-1);
+            SIM_CYCLES(2*CY_ADD32+12+length*CY_SHIFT32);
+            return (uint16_t)(total>>length);
+    }
+}
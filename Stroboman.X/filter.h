@@ -0,0 +1,22 @@
+//
+// Smoothing of the RPM readings
+//
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+
+#define FILTER_BOXCAR       0   // Moving average over 2^length samples
+#define FILTER_IIR          1   // Exponential average, weight 1/2^length
+#define FILTER_MEDIAN       2   // Median of the last length samples (odd, max 5)
+#define FILTER_DESPIKE      0x80 // Or'ed to the above, median-of-3 in front
+
+#define FILTER_MAXLOG2      5   // Longest boxcar is 32 samples
+#define FILTER_MAXMEDIAN    5
+
+void FilterSetup(uint8_t mode, uint8_t length);
+void FilterReset(void);
+uint16_t FilterAdd(uint16_t sample);
+
+#endif
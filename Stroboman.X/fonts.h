@@ -0,0 +1,25 @@
+//
+// Fonts for the LCD, made by Fonts/fontgen, edit the font files there
+//
+
+#ifndef FONTS_H
+#define FONTS_H
+
+#include <stdint.h>
+
+typedef struct {
+    const uint8_t *glyphs;      // Page by page, width bytes each
+    const uint8_t *map;         // Glyph for each character from first on
+    uint8_t first;
+    uint8_t count;              // Characters in the map
+    uint8_t width;
+    uint8_t pages;
+} t_font;
+
+#define FONT_DEGREE       "\x7F"
+#define FONT_MICRO        "\x80"
+
+extern const t_font fontBig;
+extern const t_font fontSmall;
+
+#endif
@@ -0,0 +1,127 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "format.h"
+
+//
+// Each digit is the remainder of a divide by 10, and dividing by 10 is
+// done by multiplying with its reciprocal instead: x/10 is exactly
+// x*0xCCCD>>19 for any 16 bit x, one 16x16 multiply where a software
+// divide would take hundreds of cycles. 32 bit values are divided a byte
+// at a time, long division style, each step being a 16 bit divide of the
+// remainder so far and the next byte. Values that fit in 16 bits take
+// the short way.
+//
+// The digits come out right to left into a fixed width field, with the
+// decimal point put in after the set number of decimals. A value too big
+// for the field comes out as dashes rather than with its top cut off.
+//
+
+#define DIV10(x)    ((uint16_t)(((uint32_t)(x)*0xCCCDU)>>19))
+
+
+
+//
+// Keep the type within what fits the field: 1 to 10 digits, and at least
+// one of them in front of the point or the point would never be written
+//
+static uint8_t Check(uint8_t type) {
+    uint8_t digits;
+
+    digits=type&0x0F;
+    if (digits<1) digits=1;
+    if (digits>10) digits=10;
+    if (((type>>4)&3)>=digits) type=(type&~0x30)|FORMAT_DECIMALS(digits-1);
+    SIM_CYCLES(CY_CALL+12);
+    return (type&0xF0)|digits;
+}
+
+
+
+//
+// Lay out the number in buf, now that its digits are there
+//
+static uint8_t Finish(char *buf, uint8_t type, uint8_t overflow) {
+    uint8_t digits, len, units, i;
+
+    digits=type&0x0F;
+    len=digits+((type&0x30) ? 1 : 0);
+    buf[len]=0;
+    if (overflow) {
+        for (i=0; i<len; i++) {
+            if (buf[i]!='.') buf[i]='-';
+        }
+        SIM_CYCLES(len*6);
+    } else if (type&FORMAT_BLANK) {
+        // Never the units, a zero is still a 0
+        units=digits-((type>>4)&3)-1;
+        for (i=0; i<units && buf[i]=='0'; i++) {
+            buf[i]=' ';
+            SIM_CYCLES(6);
+        }
+    }
+    SIM_CYCLES(CY_CALL+12);
+    return len;
+}
+
+
+
+//
+// Write value as type says into buf, FORMAT_MAXLEN long at most. Returns
+// the number of characters.
+//
+uint8_t FormatUint16(char *buf, uint16_t value, uint8_t type) {
+    uint8_t digits, decimals, pos;
+    uint16_t q;
+
+    type=Check(type);
+    digits=type&0x0F;
+    decimals=(type>>4)&3;
+    pos=digits+(decimals ? 1 : 0);
+    while (digits--) {
+        q=DIV10(value);
+        buf[--pos]='0'+(uint8_t)(value-q*10);
+        value=q;
+        if (decimals && !--decimals) buf[--pos]='.';
+        SIM_CYCLES(CY_MUL16+16);
+    }
+    SIM_CYCLES(CY_CALL+12);
+    return Finish(buf, type, value!=0);
+}
+
+
+
+//
+// Same for 32 bit values
+//
+uint8_t FormatUint32(char *buf, uint32_t value, uint8_t type) {
+    uint8_t digits, decimals, pos, r, i;
+    uint16_t v, q;
+    uint32_t quotient;
+
+    if (!(value>>16)) return FormatUint16(buf, (uint16_t)value, type);
+    type=Check(type);
+    digits=type&0x0F;
+    decimals=(type>>4)&3;
+    pos=digits+(decimals ? 1 : 0);
+    while (digits--) {
+        // Divide by 10 a byte at a time from the top, the remainder of
+        // each step goes in front of the next byte
+        quotient=0;
+        r=0;
+        for (i=24; ; i-=8) {
+            v=((uint16_t)r<<8)|(uint8_t)(value>>i);
+            q=DIV10(v);
+            r=(uint8_t)(v-q*10);
+            quotient|=(uint32_t)q<<i;
+            SIM_CYCLES(CY_MUL16+16);
+            if (!i) break;
+        }
+        buf[--pos]='0'+r;
+        value=quotient;
+        if (decimals && !--decimals) buf[--pos]='.';
+        SIM_CYCLES(12);
+    }
+    SIM_CYCLES(CY_CALL+CY_ADD32+12);
+    return Finish(buf, type, value!=0);
+}
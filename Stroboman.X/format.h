@@ -0,0 +1,20 @@
+//
+// Numbers to decimal digits without dividing
+//
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdint.h>
+
+#define FORMAT_DIGITS(n)    (n)         // Digits in all, 1 to 10
+#define FORMAT_DECIMALS(n)  ((n)<<4)    // After the point, 0 to 3, under the digits
+#define FORMAT_BLANK        0x40        // Leading zeros as spaces
+#define FORMAT_MAXLEN       12          // Longest result with the point and the NUL
+
+// Bit 7 of the type is left for callers, see LcdPrintUint16()
+
+uint8_t FormatUint16(char *buf, uint16_t value, uint8_t type);
+uint8_t FormatUint32(char *buf, uint32_t value, uint8_t type);
+
+#endif
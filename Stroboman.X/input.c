@@ -0,0 +1,298 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "input.h"
+
+//
+// The encoder and the buttons are sampled from the main loop every
+// INPUT_TICKS of Timer0, the same way display.c times its frames. None of
+// it runs in the ISR, so turning the knob while the strobe runs adds
+// nothing to the latency of the tach edge or the LED timers. Sampling at
+// a fixed rate also does most of the debouncing: contact bounce dies down
+// within a sample or two.
+//
+// The encoder goes through a full cycle of its two contacts for every
+// detent and rests with both open. Each valid step of the Gray code counts
+// a quarter of a detent one way or the other, so a bouncing contact just
+// counts back and forth, and a detent is only taken once the encoder is
+// back at rest at least half a cycle from where it started. Detents that
+// come in quick succession are worth more steps, so a long range can be
+// covered with a quick spin and still be set to the last step slowly.
+//
+// A button has to read the same for INPUT_DEBOUNCE samples in a row before
+// its press is believed. UP and DOWN repeat while they are held.
+//
+// The buttons on port B can wake the chip up from sleep with an
+// interrupt-on-change, the encoder and its switch on port C can't. The
+// display is off while it sleeps, so the press that woke it only turns
+// it back on: no press counts until the buttons have all been let go of
+// for INPUT_WOKEN samples.
+//
+// The events go into a ring like the tach samples, except that both ends
+// are in the main loop. Turns are added onto a turn still waiting in the
+// ring, so a fast spin doesn't fill it up.
+//
+// Wiring, the contacts close to ground:
+//   RC3 <- encoder A, RC4 <- encoder B, RC5 <- encoder switch, these need
+//   the pull-ups on the board, port C has none of its own
+//   RB4 <- BUT-UP, RB5 <- BUT-OK, RB7 <- BUT-DO, with the weak pull-ups
+//   of port B. RB4 doubles as the MSSP's SDI, which only means the bytes
+//   read back from the LCD are garbage while UP is pressed.
+//
+
+#define ENC_SHIFT       3           // A and B on RC3 and RC4
+#define ENC_REST        3           // Both contacts open
+#define KEY_UP          0x10        // PORTB
+#define KEY_OK          0x20        // PORTB
+#define KEY_DOWN        0x80        // PORTB
+#define KEY_PUSH        0x20        // PORTC
+#define KEY_REPEATS     ((1<<INPUT_UP)|(1<<INPUT_DOWN))
+
+// Quarter detent for each pair of the previous and the current contacts,
+// (previous<<2)|current with A in bit 0 and B in bit 1. A opens first
+// going clockwise.
+static const int8_t quadrature[16]={
+     0,  1, -1,  0,
+    -1,  0,  0,  1,
+     1,  0,  0, -1,
+     0, -1,  1,  0,
+};
+
+// Samples between detents below which each detent counts for more
+static const struct {
+    uint8_t gap;
+    int8_t steps;
+} accel[]={
+    { 16, 10 },     // Under 8ms
+    { 40, 4 },      // Under 20ms
+    { 80, 2 },      // Under 40ms
+};
+
+static uint16_t last;
+static uint16_t elapsed;
+
+static uint8_t contacts=ENC_REST;
+static int8_t quarters;         // Quarter detents since the encoder last rested
+static uint8_t sinceDetent=0xFF;        // Samples, stops at 255
+static int8_t lastDir;
+
+static uint8_t keys;            // Debounced, bit per INPUT_KEYS
+static uint8_t steady[INPUT_KEYS];      // Samples a key has read differently
+static uint8_t held;            // Samples the keys have been as they are
+static uint8_t woken;           // Samples until a press counts again after waking up
+
+static t_inputEvent ring[INPUT_QUEUESIZE];
+static uint8_t head;
+static uint8_t tail;
+static uint16_t dropped;
+
+
+
+//
+// Queue up an event, a turn goes onto a turn the same way that's still
+// waiting
+//
+static void Push(uint8_t what, int8_t steps) {
+    t_inputEvent *e;
+
+    SIM_CYCLES(CY_CALL+10);
+    if (head!=tail && what==INPUT_TURN) {
+        e=&ring[(uint8_t)(head-1)&(INPUT_QUEUESIZE-1)];
+        if (e->what==INPUT_TURN && (e->steps^steps)>=0
+                && e->steps<=100 && e->steps>=-100) {
+            e->steps+=steps;
+            SIM_CYCLES(12);
+            return;
+        }
+    }
+    if ((uint8_t)(head-tail)>=INPUT_QUEUESIZE) {
+        dropped++;
+        return;
+    }
+    e=&ring[head&(INPUT_QUEUESIZE-1)];
+    e->what=what;
+    e->steps=steps;
+    head++;
+    SIM_CYCLES(14);
+}
+
+
+
+//
+// The encoder has clicked into a detent
+//
+static void Detent(int8_t dir) {
+    int8_t steps=1;
+    uint8_t i;
+
+    // Turning back is always a single step
+    if (dir==lastDir) {
+        for (i=0; i<sizeof(accel)/sizeof(accel[0]); i++) {
+            SIM_CYCLES(CY_TBLRD+6);
+            if (sinceDetent<accel[i].gap) {
+                steps=accel[i].steps;
+                break;
+            }
+        }
+    }
+    lastDir=dir;
+    sinceDetent=0;
+    Push(INPUT_TURN, dir<0 ? -steps : steps);
+    SIM_CYCLES(CY_CALL+12);
+}
+
+
+
+//
+// Set up the pins, Timer0 has to be running
+//
+void InputSetup(void) {
+    TRISB|=KEY_UP|KEY_OK|KEY_DOWN;
+    TRISC|=(3<<ENC_SHIFT)|KEY_PUSH;
+    WPUB=KEY_UP|KEY_OK|KEY_DOWN;
+    INTCON2bits.nRABPU=0;       // Enable the weak pull-ups
+    last=TMR0L;
+    last|=(uint16_t)TMR0H<<8;   // Latched when TMR0L was read
+}
+
+
+
+//
+// Called from the main loop, samples the inputs when it's time
+//
+void InputPoll(void) {
+    uint16_t now;
+    uint8_t b, c, raw, bit, i;
+
+    now=TMR0L;
+    now|=(uint16_t)TMR0H<<8;    // Latched when TMR0L was read
+    elapsed+=now-last;
+    last=now;
+    SIM_CYCLES(CY_CALL+10);
+    if (elapsed<INPUT_TICKS) return;
+    // Samples that were missed are dropped, not caught up with
+    elapsed=elapsed<2*INPUT_TICKS ? elapsed-INPUT_TICKS : 0;
+
+    b=PORTB;
+    c=PORTC;
+
+    // Encoder
+    raw=(c>>ENC_SHIFT)&3;
+    quarters+=quadrature[(contacts<<2)|raw];
+    contacts=raw;
+    if (sinceDetent!=0xFF) sinceDetent++;
+    SIM_CYCLES(CY_TBLRD+16);
+    if (raw==ENC_REST) {
+        if (quarters>=2) Detent(1);
+        else if (quarters<=-2) Detent(-1);
+        quarters=0;
+    }
+
+    // Buttons, pressed reads low
+    raw=0;
+    if (!(b&KEY_UP)) raw|=1<<INPUT_UP;
+    if (!(b&KEY_OK)) raw|=1<<INPUT_OK;
+    if (!(b&KEY_DOWN)) raw|=1<<INPUT_DOWN;
+    if (!(c&KEY_PUSH)) raw|=1<<INPUT_PUSH;
+    SIM_CYCLES(12);
+    if (held!=0xFF) held++;
+    for (i=0, bit=1; i<INPUT_KEYS; i++, bit<<=1) {
+        SIM_CYCLES(8);
+        if (!((raw^keys)&bit)) {
+            steady[i]=0;
+            continue;
+        }
+        if (++steady[i]<INPUT_DEBOUNCE) continue;
+        steady[i]=0;
+        keys^=bit;
+        held=0;
+        if ((keys&bit) && !woken) Push(i, 0);
+    }
+    if (woken) {
+        if (keys) woken=INPUT_WOKEN;
+        else woken--;
+        SIM_CYCLES(4);
+        return;
+    }
+
+    // Repeat UP or DOWN while held
+    if ((keys&KEY_REPEATS) && held>=INPUT_DELAY) {
+        held=INPUT_DELAY-INPUT_REPEAT;
+        if (keys&(1<<INPUT_UP)) Push(INPUT_UP, 0);
+        if (keys&(1<<INPUT_DOWN)) Push(INPUT_DOWN, 0);
+    }
+}
+
+
+
+//
+// Timer0 ticks until the next sample is due, 0 if it is already
+//
+uint16_t InputDue(void) {
+    uint16_t now, since;
+
+    now=TMR0L;
+    now|=(uint16_t)TMR0H<<8;    // Latched when TMR0L was read
+    since=elapsed+(uint16_t)(now-last);
+    SIM_CYCLES(CY_CALL+10);
+    return since<INPUT_TICKS ? INPUT_TICKS-since : 0;
+}
+
+
+
+//
+// Fetch the oldest event, returns 0 if there is none
+//
+uint8_t InputPop(t_inputEvent *event) {
+    SIM_CYCLES(CY_CALL+6);
+    if (tail==head) return 0;
+    *event=ring[tail&(INPUT_QUEUESIZE-1)];
+    tail++;
+    SIM_CYCLES(12);
+    SIM_EVENT(SIM_EV_INPUT);
+    return 1;
+}
+
+
+
+//
+// The buttons held down right now, bit per INPUT_KEYS
+//
+uint8_t InputKeys(void) {
+    return keys;
+}
+
+
+
+//
+// Number of events dropped because the ring was full
+//
+uint16_t InputDropped(void) {
+    return dropped;
+}
+
+
+
+//
+// Have a change of the buttons wake the chip up from sleep, only with the
+// interrupts off: the ISR doesn't deal with it
+//
+void InputWakeOn(void) {
+    IOCB=KEY_UP|KEY_OK|KEY_DOWN;
+    (void)PORTB;                // Ends the mismatch, only a change from now on counts
+    RABIF=0;
+    RABIE=1;
+}
+
+
+
+//
+// The chip has woken up, the press that may have done it doesn't count
+//
+void InputWoken(void) {
+    RABIE=0;
+    IOCB=0;
+    (void)PORTB;
+    RABIF=0;
+    woken=INPUT_WOKEN;
+}
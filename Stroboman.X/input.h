@@ -0,0 +1,39 @@
+//
+// Rotary encoder and buttons, debounced into a queue of events
+//
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+
+#define INPUT_TICKS     6000    // Timer0 ticks between samples, 0.5ms
+#define INPUT_DEBOUNCE  8       // Samples a button has to be steady for, 4ms
+#define INPUT_DELAY     200     // Samples a button is held before it repeats, 100ms
+#define INPUT_REPEAT    160     // Samples between repeats, 80ms
+#define INPUT_QUEUESIZE 4       // Must be a power of two
+#define INPUT_WOKEN     40      // Samples after waking up before a press counts, 20ms
+
+// What happened, the buttons are bits in INPUT_KEYS order
+#define INPUT_UP        0
+#define INPUT_OK        1
+#define INPUT_DOWN      2
+#define INPUT_PUSH      3       // The encoder's own switch
+#define INPUT_KEYS      4
+#define INPUT_TURN      4       // Encoder turned, steps has the amount
+
+typedef struct {
+    uint8_t what;
+    int8_t steps;               // Detents turned, more when spun fast, negative anticlockwise
+} t_inputEvent;
+
+void InputSetup(void);
+void InputPoll(void);
+uint16_t InputDue(void);
+uint8_t InputPop(t_inputEvent *event);
+uint8_t InputKeys(void);
+uint16_t InputDropped(void);
+void InputWakeOn(void);
+void InputWoken(void);
+
+#endif
@@ -0,0 +1,461 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "format.h"
+#include "lcd.h"
+
+//
+// The controller takes 9 bit words, a command/data bit followed by the
+// byte. LcdSend() clocks the first bit by hand and the byte with the
+// MSSP, which means toggling the chip select and the MSSP for every byte.
+// Longer runs are packed instead: with the chip select held low the
+// controller just keeps shifting, so 8 words are sent as 9 bytes straight
+// through the MSSP. A run is padded with NOP commands to a multiple of 8
+// words.
+//
+// There isn't RAM for a copy of the 864 bytes on the screen, so what is
+// shadowed is what has been drawn where: a table of cells, each a glyph
+// of one of the two fonts at a page and column, in three bytes. Drawing
+// the same thing in the same place again costs nothing, anything else
+// marks the rows of the cell dirty. The fonts made by ../Fonts/fontgen
+// are stored page by page, so each row of a cell goes out as one run,
+// and a row of text runs on from glyph to glyph without moving the
+// cursor: a glyph always costs width*pages data words.
+//
+// Nothing here waits for the display. LcdInit(), LcdClear(), LcdPower()
+// and LcdCell() only note what needs doing and LcdPump(), called from the
+// main loop, works out the words to send as it goes: the setup commands
+// once the controller is out of reset, then the power save ones, then a
+// clear, then the dirty rows of the cells, moving the cursor only where
+// they don't follow on from each other. Each call sends at most LCD_SLICE
+// bytes, working out the next word while the MSSP shifts out the last
+// one, so the main loop is never held up for long however much there is
+// to redraw.
+//
+
+#define SPI_CLOCK_TRIS  TRISBbits.TRISB6
+#define SPI_CLOCK       LATBbits.LATB6
+#define SPI_CS_TRIS     TRISCbits.TRISC6
+#define SPI_CS          LATCbits.LATC6
+#define SPI_DATA_TRIS   TRISCbits.TRISC7
+#define SPI_DATA        LATCbits.LATC7
+
+#define LCD_CE_LOW      SPI_CS=0
+#define LCD_CE_HIGH     SPI_CS=1
+
+#define LCD_CLK_LOW     SPI_CLOCK=0
+#define LCD_CLK_HIGH    SPI_CLOCK=1
+
+#define LCD_DI_LOW      SPI_DATA=0
+#define LCD_DI_HIGH     SPI_DATA=1
+
+#define LCD_NOP         0xE3
+#define LCD_NONE        0xFFFF      // No word to send
+#define LCD_RESETTICKS  100000UL    // Timer0 ticks for the controller to reset
+
+typedef struct {
+    uint8_t col;
+    uint8_t glyph;              // Of the font, 0 is the space
+    uint8_t page:4;
+    uint8_t big:1;              // fontBig, otherwise fontSmall
+    uint8_t dirty:3;            // Bit per row still to be sent
+} t_lcdCell;
+
+static const uint8_t setupCommands[]={
+    0x3D,   // Charge pump ON
+    0x01,   // Charge pump=4
+    0xA4,   // Display all points = OFF
+    0x2F,   // Booster=ON, Voltage Reg=ON, Voltage Follower=ON
+    0xAF,   // Display ON
+    0xA6,   // Normal display
+    0xC8,   // Normal C0/C8 screen up/down
+    0xA1,   // Normal A0/A1 screen left/right
+};
+
+// Power save is the display off with all of its points on, the RAM and
+// the picture in it are kept
+static const uint8_t sleepCommands[]={
+    0xAE,   // Display OFF
+    0xA5,   // Display all points = ON
+};
+
+static const uint8_t wakeCommands[]={
+    0xA4,   // Display all points = OFF
+    0xAF,   // Display ON
+};
+
+static t_lcdCell cells[LCD_CELLS];
+static uint8_t used;
+static uint16_t dirtyPages;             // Bit per page
+static uint8_t hint;                    // Cell after the one LcdCell() found last
+
+// What LcdPump() is up to
+static uint8_t resetting;               // Waiting for the controller to come out of reset
+static uint16_t resetFrom;
+static uint32_t resetTicks;
+static uint8_t setup=sizeof(setupCommands);     // Next of the setup commands
+static const uint8_t *power;            // Power save commands still to send
+static uint8_t powerLeft;
+static uint16_t clearing;               // Blank words still to send
+static uint8_t moving;                  // Cursor words still to send
+static uint8_t movePage, moveCol;
+static uint8_t page=LCD_PAGES-1;        // Page dirty rows are being looked for on
+static uint8_t cell;                    // Next cell to look at on that page
+static uint8_t rowLeft;                 // Words still to send of the current row
+static const uint8_t *row;
+static uint8_t curPage=0xFF, curCol;    // Where the controller will write next
+static uint8_t burst;                   // Chip select is low
+static uint8_t busy;                    // The MSSP is shifting out a byte
+
+// Where LcdCharacter() and friends draw next
+static uint8_t textPage, textCol;
+
+// Packing of 9 bit words into bytes
+static uint16_t pending;
+static uint8_t pendingBits;
+
+
+
+void SpiSetup() {
+    // Set SPI ports to output
+    SPI_CS_TRIS=0;
+    SPI_DATA_TRIS=0;
+    SPI_CLOCK_TRIS=0;
+    LCD_CE_HIGH;
+
+    SSPCON1 = 0b00000001;       //
+    SSPSTATbits.SMP = 0;        //
+    SSPSTATbits.CKE = 1;        // transmit data on rising edge of clock
+    SSPCON1bits.SSPEN=0;        // Disable SPI
+}
+
+
+
+
+
+
+//
+//
+//
+uint8_t SpiSend(uint8_t data) {
+    SSPBUF=data;
+    while(!SSPSTATbits.BF);
+    return SSPBUF;
+}
+
+
+//
+// Send a byte to the display, either as a command or data depending on the "cd" flag
+//
+void LcdSend(uint8_t cd, uint8_t data) {
+    SIM_CYCLES(CY_CALL+2);
+    LCD_CE_LOW;                                   // Enable LCD ~CE
+    if (cd==0) LCD_DI_LOW; else LCD_DI_HIGH;      // Command/Data-bit
+    NOP();
+    LCD_CLK_HIGH;
+    NOP();
+    LCD_CLK_LOW;
+    SSPCON1bits.SSPEN=1;        // Enable SPI
+    SpiSend(data);
+    SSPCON1bits.SSPEN=0;        // Disable SPI
+    LCD_CE_HIGH;                                  // Disable LCD ~CE
+}
+
+
+
+//
+// Have the words that move the controller's cursor sent next
+//
+static void MoveTo(uint8_t col, uint8_t pg) {
+    movePage=curPage=pg;
+    moveCol=curCol=col;
+    moving=3;
+}
+
+
+
+//
+// The next of the words moving the cursor
+//
+static uint16_t MoveWord(void) {
+    SIM_CYCLES(CY_CALL+8);
+    switch (moving--) {
+        case 3: return 0xB0 | movePage;
+        case 2: return 0x10 | ((moveCol >> 4) & 0x07);
+        default: return 0x00 | (moveCol & 0x0F);
+    }
+}
+
+
+
+//
+// Set the cursor position for LcdCharacter()/LcdString()
+// The x coordinate is in pixels, the y coordinate is the page
+// ranging from 0 to 8
+//
+void LcdXY(uint8_t x, uint8_t y) {
+  textCol=x;
+  textPage=y;
+}
+
+
+
+//
+// Blank the whole screen and forget about the cells on it
+//
+void LcdClear(void){
+  SIM_CYCLES(CY_CALL+14);
+  clearing=LCD_COLS*LCD_PAGES;
+  MoveTo(0, 0);
+  curPage=0xFF;         // Where the clear leaves the cursor is up to the controller
+  rowLeft=0;            // Drop whatever row was being sent
+  cell=used=0;
+  dirtyPages=0;
+}
+
+
+
+//
+// Reset the display, the rest of the setup is sent by LcdPump() once it
+// has had time to come out of reset. Timer0 has to be running.
+//
+void LcdInit(void) {
+    LcdSend(LCD_C, 0xE2);  // Software Reset
+    resetFrom=TMR0L;
+    resetFrom|=(uint16_t)TMR0H<<8;      // Latched when TMR0L was read
+    resetTicks=0;
+    resetting=1;
+    setup=0;
+    curPage=0xFF;
+    SIM_CYCLES(CY_CALL+12);
+}
+
+
+
+//
+// Put a glyph of font on the screen, shows up once LcdPump() gets to it.
+// Each place on the screen takes up a cell until the next LcdClear().
+//
+static void LcdCell(uint8_t page, uint8_t col, const t_font *font, uint8_t glyph) {
+    t_lcdCell *c;
+    uint8_t i, n, big;
+
+    // Screens are drawn in the same order every time, so the cell is
+    // usually the one after the last
+    i=hint;
+    for (n=used; n; n--) {
+        SIM_CYCLES(12);
+        if (i>=used) i=0;
+        if (cells[i].page==page && cells[i].col==col) break;
+        i++;
+    }
+    if (!n) i=used;
+    SIM_CYCLES(CY_CALL+10);
+    if (i==LCD_CELLS) return;       // No room, the layout has too many cells
+    hint=i+1;
+    c=&cells[i];
+    big=font==&fontBig;
+    if (i==used) {
+        used++;
+    } else if (c->glyph==glyph && c->big==big) {
+        return;                     // Already on the screen
+    }
+    c->glyph=glyph;
+    c->page=page;
+    c->col=col;
+    c->big=big;
+    c->dirty=(uint8_t)((1U<<font->pages)-1);
+    dirtyPages|=((1U<<font->pages)-1)<<page;
+    SIM_CYCLES(CY_TBLRD+26);
+}
+
+
+
+//
+// Draw a character of font at the cursor and move the cursor on past it
+//
+void LcdGlyph(const t_font *font, char ch) {
+    uint8_t i, glyph;
+
+    i=(uint8_t)ch-font->first;
+    glyph=i<font->count ? font->map[i] : 0;     // 0 is the space
+    LcdCell(textPage, textCol, font, glyph);
+    textCol+=font->width;
+    SIM_CYCLES(CY_CALL+CY_TBLRD+16);
+}
+
+
+
+void LcdCharacter(char ch) {
+    LcdGlyph(&fontSmall, ch);
+}
+
+void LcdBigCharacter(char ch) {
+    LcdGlyph(&fontBig, ch);
+}
+
+void LcdString(const char *string) {
+    while (*string) {
+        LcdGlyph(&fontSmall, *string++);
+        SIM_CYCLES(6);
+    }
+}
+
+
+
+//
+// Print value at the cursor, type is FORMAT_DIGITS() and the rest of the
+// format.h flags, or'ed with LCD_BIG for the big font
+//
+void LcdPrintUint16(uint16_t value, uint8_t type) {
+    char buf[FORMAT_MAXLEN];
+    const t_font *font;
+    uint8_t i, n;
+
+    font=(type&LCD_BIG) ? &fontBig : &fontSmall;
+    n=FormatUint16(buf, value, type&~LCD_BIG);
+    for (i=0; i<n; i++) {
+        LcdGlyph(font, buf[i]);
+        SIM_CYCLES(6);
+    }
+}
+
+
+
+//
+// The next word to send, with the command/data bit in bit 8, or LCD_NONE
+//
+static uint16_t NextWord(void) {
+    t_lcdCell *c;
+    const t_font *font;
+    uint8_t r;
+
+    SIM_CYCLES(CY_CALL+8);
+    if (setup<sizeof(setupCommands)) {
+        return setupCommands[setup++];
+    }
+    if (powerLeft) {
+        powerLeft--;
+        return *power++;
+    }
+    if (moving) return MoveWord();
+    if (clearing) {
+        clearing--;
+        return (uint16_t)LCD_D<<8;
+    }
+
+    // Look for the next dirty row, a page at a time
+    while (!rowLeft) {
+        SIM_CYCLES(14);
+        if (cell>=used) {
+            if (!dirtyPages) return LCD_NONE;
+            do {
+                if (++page>=LCD_PAGES) page=0;
+                SIM_CYCLES(6);
+            } while (!(dirtyPages&(1U<<page)));
+            dirtyPages&=~(1U<<page);
+            cell=0;
+            continue;
+        }
+        c=&cells[cell++];
+        font=c->big ? &fontBig : &fontSmall;
+        if (page<c->page || page>=c->page+font->pages) continue;
+        r=page-c->page;
+        if (!(c->dirty&(1<<r))) continue;
+        // Cleared before the row goes out, so a change to the cell while
+        // it's being sent has the row sent again
+        c->dirty&=~(1<<r);
+        row=font->glyphs+(c->glyph*(uint16_t)font->pages+r)*font->width;
+        rowLeft=font->width;
+        SIM_CYCLES(2*CY_TBLRD+CY_MUL16+12);
+        if (page!=curPage || c->col!=curCol) MoveTo(c->col, page);
+        curCol+=font->width;
+    }
+    if (moving) return MoveWord();
+    rowLeft--;
+    r=*row++;
+    SIM_CYCLES(CY_TBLRD+4);
+    return ((uint16_t)LCD_D<<8)|r;
+}
+
+
+
+//
+// Send some more of what's waiting to go to the display, called from the
+// main loop. Waits at most for the byte already in the MSSP.
+//
+void LcdPump(void) {
+    uint16_t w, now;
+    uint8_t n;
+
+    SIM_CYCLES(CY_CALL+4);
+    if (resetting) {
+        now=TMR0L;
+        now|=(uint16_t)TMR0H<<8;
+        resetTicks+=(uint16_t)(now-resetFrom);
+        resetFrom=now;
+        SIM_CYCLES(CY_ADD32+8);
+        if (resetTicks<LCD_RESETTICKS) return;
+        resetting=0;
+    }
+
+    n=LCD_SLICE;
+    for (;;) {
+        SIM_CYCLES(6);
+        if (busy) {
+            while (!SSPSTATbits.BF);
+            (void)SSPBUF;           // Reading the buffer clears BF
+            busy=0;
+        }
+        if (pendingBits>=8) {
+            if (!n) return;
+            n--;
+            pendingBits-=8;
+            SSPBUF=(uint8_t)(pending>>pendingBits);
+            busy=1;
+            SIM_CYCLES(10);
+            continue;
+        }
+        w=NextWord();
+        if (w==LCD_NONE) {
+            if (!burst) return;
+            if (!pendingBits) {
+                SSPCON1bits.SSPEN=0;
+                LCD_CE_HIGH;
+                burst=0;
+                return;
+            }
+            w=LCD_NOP;              // Pad out the last byte
+        }
+        if (!burst) {
+            LCD_CE_LOW;
+            SSPCON1bits.SSPEN=1;
+            burst=1;
+        }
+        pending=(pending<<9)|w;
+        pendingBits+=9;
+        SIM_CYCLES(14);
+    }
+}
+
+
+
+//
+// Put the display in power save or take it out again, LcdPump() sends
+// the commands
+//
+void LcdPower(uint8_t on) {
+    power=on ? wakeCommands : sleepCommands;
+    powerLeft=sizeof(sleepCommands);
+    SIM_CYCLES(CY_CALL+6);
+}
+
+
+
+//
+// Anything still waiting to go to the display
+//
+uint8_t LcdBusy(void) {
+    return resetting || burst || setup<sizeof(setupCommands) || powerLeft || moving
+        || clearing || rowLeft || dirtyPages || cell<used;
+}
@@ -0,0 +1,36 @@
+//
+// 96x68 LCD with a 9 bit SPI interface, a shadow of what's on it and
+// the queue of what's still to be sent
+//
+
+#ifndef LCD_H
+#define LCD_H
+
+#include <stdint.h>
+#include "fonts.h"
+
+#define LCD_C           0         // Command mode for LCD
+#define LCD_D           1         // Data mode LCD
+
+#define LCD_COLS        96
+#define LCD_PAGES       9         // Rows of 8 pixels
+#define LCD_CELLS       28        // Things on the screen the shadow keeps track of
+#define LCD_SLICE       16        // Most bytes sent for each call of LcdPump()
+#define LCD_BIG         0x80      // LcdPrintUint16() in the big font
+
+void SpiSetup(void);
+uint8_t SpiSend(uint8_t data);
+void LcdSend(uint8_t cd, uint8_t data);
+void LcdInit(void);
+void LcdXY(uint8_t x, uint8_t y);
+void LcdClear(void);
+void LcdGlyph(const t_font *font, char ch);
+void LcdCharacter(char ch);
+void LcdBigCharacter(char ch);
+void LcdString(const char *string);
+void LcdPrintUint16(uint16_t value, uint8_t type);
+void LcdPump(void);
+void LcdPower(uint8_t on);
+uint8_t LcdBusy(void);
+
+#endif
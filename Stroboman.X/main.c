@@ -57,6 +57,22 @@
 
 #include <stdint.h>
 #include <delays.h>
+#include "simhooks.h"
+#include "rpm.h"
+#include "filter.h"
+#include "tach.h"
+#include "strobe.h"
+#include "pulse.h"
+#include "lcd.h"
+#include "display.h"
+#include "format.h"
+#include "input.h"
+#include "menu.h"
+#include "settings.h"
+#include "usb.h"
+#include "telemetry.h"
+#include "profile.h"
+#include "power.h"
 
 
 //
@@ -80,6 +96,14 @@
 // RB6 -> LCD_CLOCK
 // RC6 -> LCD_CS
 // RC7 -> LCD_DATA
+// RB4 <- BUT-UP
+// RB5 <- BUT-OK
+// RB7 <- BUT-DO
+// RC3 <- ENCODER A
+// RC4 <- ENCODER B
+// RC5 <- ENCODER SWITCH
+// RA0 <-> USB D+
+// RA1 <-> USB D-
 //
 
 #define TACH_TRIS       TRISCbits.TRISC1
@@ -89,25 +113,6 @@
 #define LED_TRIS        TRISCbits.TRISC0
 #define LED             LATCbits.LATC0
 
-#define LCD_C           0         // Command mode for LCD
-#define LCD_D           1         // Data mode LCD
-
-#define SPI_CLOCK_TRIS  TRISBbits.TRISB6
-#define SPI_CLOCK       LATBbits.LATB6
-#define SPI_CS_TRIS     TRISCbits.TRISC6
-#define SPI_CS          LATCbits.LATC6
-#define SPI_DATA_TRIS   TRISCbits.TRISC7
-#define SPI_DATA        LATCbits.LATC7
-
-#define LCD_CE_LOW      SPI_CS=0
-#define LCD_CE_HIGH     SPI_CS=1
-
-#define LCD_CLK_LOW     SPI_CLOCK=0
-#define LCD_CLK_HIGH    SPI_CLOCK=1
-
-#define LCD_DI_LOW      SPI_DATA=0
-#define LCD_DI_HIGH     SPI_DATA=1
-
 
 typedef struct {
     uint8_t lowestByte;
@@ -122,350 +127,261 @@ typedef union {
   } t_4bytes32;
 
 
-static volatile uint32_t tach;
+// Timer0 runs free and is never reloaded, this counts its overflows and
+// makes up the top 16 bits of the 32 bit timebase
+static volatile uint16_t tach_overflow;
 
-static volatile uint8_t tach_overflow;
-static volatile uint8_t newTachData;
-static volatile t_4bytes32 tachData;
+// Number of times Timer1 has to wrap before the next flash is due
+static uint16_t flashOverflows;
 
-static volatile uint16_t delay;
+// The time that flash is aimed at
+static uint32_t flashAt;
 
+// A revolution has started since the tach was last restarted, the next
+// edge that ends one gives a period
+static uint8_t tachValid;
 
-uint8_t SpiSend(uint8_t data);
-void LcdInit(void);
-void LcdXY(uint8_t x, uint8_t y);
-void LcdClear(void);
-void LcdCharacter(char ch);
-void LcdTinyDigit(char ch);
-void LcdString(char *string);
-void LcdPrintUint16(uint16_t value, uint8_t type);
+// Timer0 added up by the main loop, see LoopTime()
+static uint32_t loopTime;
+static uint16_t loopLast;
 
 
 
-void SpiSetup() {
-    // Set SPI ports to output
-    SPI_CS_TRIS=0;
-    SPI_DATA_TRIS=0;
-    SPI_CLOCK_TRIS=0;
-    LCD_CE_HIGH;
-
-    SSPCON1 = 0b00000001;       // 
-    SSPSTATbits.SMP = 0;        //
-    SSPSTATbits.CKE = 1;        // transmit data on rising edge of clock
-    SSPCON1bits.SSPEN=0;        // Disable SPI
-}
-
-
+// Light up the LED and start Timer2 that will turn it off again, then
+// queue the time it was aimed at for the telemetry
+#define LED_FLASH(at) do {                                      \
+        SIM_CYCLES(2);                                          \
+        if (pulseHold) break;   /* Over the power budget */     \
+        LED=1;                                                  \
+        TMR2=0;             /* The timer should start from zero */ \
+        PR2=PulseOn();      /* On-time for this flash */        \
+        TMR2IF=0;           /* Clear Timer2 interupt flag */    \
+        TMR2IE=1;           /* Enable Timer2 interrupts */      \
+        SIM_CYCLES(2);                                          \
+        if (telemetryOn) TelemetryFlash(at);                    \
+    } while (0)
 
 
 
-
-//
-//
-//
-uint8_t SpiSend(uint8_t data) {
-    SSPBUF=data;
-    while(!SSPSTATbits.BF);
-    return SSPBUF;
-}
-
-
 //
-// Send a byte to the display, either as a command or data depending on the "cd" flag
+// Read the 32 bit timebase, only to be called from the ISR
 //
-void LcdSend(uint8_t cd, uint8_t data) {
-    LCD_CE_LOW;                                   // Enable LCD ~CE
-    if (cd==0) LCD_DI_LOW; else LCD_DI_HIGH;      // Command/Data-bit
-    NOP();
-    LCD_CLK_HIGH;
-    NOP();
-    LCD_CLK_LOW;
-    SSPCON1bits.SSPEN=1;        // Enable SPI
-    SpiSend(data);
-    SSPCON1bits.SSPEN=0;        // Disable SPI
-    LCD_CE_HIGH;                                  // Disable LCD ~CE
+static uint32_t TimeNow(void) {
+    t_4bytes32 now;
+    uint16_t high;
+
+    now.u8.lowestByte=TMR0L;
+    now.u8.lowByte=TMR0H;       // Latched when TMR0L was read
+    high=tach_overflow;
+    // A wrap that hasn't been counted yet, see ISR()
+    if (TMR0IF && !(now.u8.lowByte&0x80)) high++;
+    now.u8.highByte=(uint8_t)high;
+    now.u8.highestByte=(uint8_t)(high>>8);
+    SIM_CYCLES(CY_CALL+8);
+    return now.u32;
 }
 
 
 
-
 //
-// Set the cursor position for LcdCharacter()/LcdString()
-// The x coordinate is in pixels, the y coordinate is the line
-// ranging from 0 to 7
+// The timebase as far as the main loop needs it, without the ISR's
+// overflow count: the ticks since the last call are added up the same
+// way DisplayDue() does. Only to be called from the main loop.
 //
-void LcdXY(uint8_t x, uint8_t y) {
-  LcdSend(LCD_C,0xB0 | (y & 0x0F));
-  LcdSend(LCD_C,0x10 | ((x >> 4) & 0x07));
-  LcdSend(LCD_C,0x00 | (x & 0x0F));
+static uint32_t LoopTime(void) {
+    uint16_t now;
+
+    now=TMR0L;
+    now|=(uint16_t)TMR0H<<8;    // Latched when TMR0L was read
+    loopTime+=(uint16_t)(now-loopLast);
+    loopLast=now;
+    SIM_CYCLES(CY_CALL+CY_ADD32+8);
+    return loopTime;
 }
 
 
 
 //
+// Set Timer1 up to turn on the LED at StrobeTarget(). A flash that is too
+// close to set up Timer1 for, or has already been passed while the ISR was
+// busy, is done right away and any others that are due by now are dropped.
 //
-//
-void LcdClear(void){
-  uint16_t i;
-  LcdXY(0,0);
-  for (i=0; i<96*9 ; i++) {
-    LcdSend(LCD_D, 0x00);
-  }
-}
-
-
-
-//
-// Send all the required initialization commands to the display
-//
-void LcdInit(void) {
-    LcdSend(LCD_C, 0xE2);  // Software Reset
-    Delay1KTCYx(100);
-    LcdSend(LCD_C, 0x3D);  // Charge pump ON
-    LcdSend(LCD_C, 0x01);  // Charge pump=4
-    LcdSend(LCD_C, 0xA4);  // Display all points = OFF
-    LcdSend(LCD_C, 0x2F);  // Booster=ON, Voltage Reg=ON, Voltage Follower=ON
-    LcdSend(LCD_C, 0xAF);  // Display ON
-    LcdSend(LCD_C, 0xA6);  // Normal display
-    LcdSend(LCD_C, 0xC8);  // Normal C0/C8 screen up/down
-    LcdSend(LCD_C, 0xA1);  // Normal A0/A1 screen left/right
-
-    //LcdClear();
-}
-
+static void ArmFlash(void) {
+    uint32_t at, ticks;
+    uint8_t flashed=0;
 
-const  char Tahoma15x24[] = {
-	0xE0, 0xFF, 0x00, 0xF8, 0xFF, 0x03, 0xFE, 0xFF, 0x0F, 0x1E, 0x00, 0x0F, 0x0F, 0x00, 0x1E, 0x07, 0x00, 0x1C, 0x07, 0x00, 0x1C, 0x07, 0x00, 0x1C, 0x0F, 0x00, 0x1E, 0x1E, 0x00, 0x0F, 0xFE, 0xFF, 0x0F, 0xF8, 0xFF, 0x03, 0xE0, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // Code for char 0
-        0x00, 0x00, 0x00, 0x30, 0x00, 0x1C, 0x38, 0x00, 0x1C, 0x38, 0x00, 0x1C, 0x3C, 0x00, 0x1C, 0xFE, 0xFF, 0x1F, 0xFF, 0xFF, 0x1F, 0xFF, 0xFF, 0x1F, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // Code for char 1
-        0x0E, 0x00, 0x1E, 0x0E, 0x00, 0x1F, 0x07, 0x80, 0x1F, 0x07, 0xC0, 0x1D, 0x07, 0xE0, 0x1C, 0x07, 0x70, 0x1C, 0x07, 0x38, 0x1C, 0x07, 0x1C, 0x1C, 0x0F, 0x0F, 0x1C, 0xFE, 0x07, 0x1C, 0xFC, 0x03, 0x1C, 0xF8, 0x00, 0x1C, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // Code for char 2
-        0x00, 0x00, 0x0E, 0x0E, 0x00, 0x0E, 0x0E, 0x00, 0x1C, 0x07, 0x00, 0x1C, 0x07, 0x0E, 0x1C, 0x07, 0x0E, 0x1C, 0x07, 0x0E, 0x1C, 0x07, 0x0E, 0x1C, 0x07, 0x0F, 0x1E, 0x8F, 0x1D, 0x0F, 0xFE, 0xFD, 0x0F, 0xFE, 0xF8, 0x07, 0x78, 0xF0, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // Code for char 3
-        0x00, 0xC0, 0x00, 0x00, 0xF0, 0x00, 0x00, 0xFC, 0x00, 0x00, 0xEF, 0x00, 0xC0, 0xE3, 0x00, 0xF0, 0xE0, 0x00, 0x3C, 0xE0, 0x00, 0x0E, 0xE0, 0x00, 0x03, 0xE0, 0x00, 0xFF, 0xFF, 0x1F, 0xFF, 0xFF, 0x1F, 0xFF, 0xFF, 0x1F, 0x00, 0xE0, 0x00, 0x00, 0xE0, 0x00, 0x00, 0x00, 0x00,  // Code for char 4
-        0x00, 0x00, 0x0E, 0xFF, 0x07, 0x0E, 0xFF, 0x07, 0x1C, 0xFF, 0x07, 0x1C, 0x07, 0x07, 0x1C, 0x07, 0x07, 0x1C, 0x07, 0x07, 0x1C, 0x07, 0x07, 0x1C, 0x07, 0x0F, 0x1E, 0x07, 0x0E, 0x0F, 0x07, 0xFE, 0x0F, 0x07, 0xFC, 0x07, 0x07, 0xF8, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // Code for char 5
-};
-
-
-const  char Tahoma15x24_5[] = {
-         0x80, 0xFF, 0x00, 0xE0, 0xFF, 0x03, 0xF8, 0xFF, 0x07, 0x7C, 0x0E, 0x0F, 0x1E, 0x06, 0x1E, 0x0E, 0x07, 0x1C, 0x0F, 0x07, 0x1C, 0x07, 0x07, 0x1C, 0x07, 0x07, 0x1C, 0x07, 0x0F, 0x1E, 0x07, 0x0E, 0x0F, 0x07, 0xFE, 0x0F, 0x00, 0xFC, 0x07, 0x00, 0xF8, 0x01, 0x00, 0x00, 0x00,  // Code for char 6
-         0x07, 0x00, 0x00, 0x07, 0x00, 0x10, 0x07, 0x00, 0x1C, 0x07, 0x00, 0x1F, 0x07, 0xC0, 0x0F, 0x07, 0xF0, 0x03, 0x07, 0xFC, 0x00, 0x07, 0x3F, 0x00, 0x87, 0x0F, 0x00, 0xE7, 0x03, 0x00, 0xFF, 0x00, 0x00, 0x7F, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // Code for char 7
-         0x00, 0xE0, 0x01, 0x78, 0xF8, 0x07, 0xFC, 0xF9, 0x0F, 0xFE, 0x0D, 0x0F, 0x8F, 0x07, 0x1E, 0x07, 0x07, 0x1C, 0x07, 0x07, 0x1C, 0x07, 0x06, 0x1C, 0x07, 0x0E, 0x1C, 0x0F, 0x0F, 0x1E, 0xFE, 0x1F, 0x0E, 0xFC, 0xF9, 0x0F, 0x78, 0xF8, 0x07, 0x00, 0xE0, 0x01, 0x00, 0x00, 0x00,  // Code for char 8
-         0xF0, 0x03, 0x00, 0xFC, 0x07, 0x00, 0xFE, 0x0F, 0x1C, 0x1E, 0x0E, 0x1C, 0x0F, 0x1E, 0x1C, 0x07, 0x1C, 0x1C, 0x07, 0x1C, 0x1C, 0x07, 0x1C, 0x1E, 0x07, 0x1C, 0x0E, 0x0F, 0x0C, 0x0F, 0x1E, 0xCE, 0x07, 0xFC, 0xFF, 0x03, 0xF8, 0xFF, 0x00, 0xE0, 0x3F, 0x00, 0x00, 0x00, 0x00,  // Code for char 9
-         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xE0, 0x01, 0x1E, 0xE0, 0x01, 0x1E, 0xE0, 0x01, 0x1E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00   // Code for char :
-};
-
-
-const char font6_8[][6] =
-{
-    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },   // sp
-    { 0x00, 0x00, 0x00, 0x2f, 0x00, 0x00 },   // !
-    { 0x00, 0x00, 0x07, 0x00, 0x07, 0x00 },   // "
-    { 0x00, 0x14, 0x7f, 0x14, 0x7f, 0x14 },   // #
-    { 0x00, 0x24, 0x2a, 0x7f, 0x2a, 0x12 },   // $
-    { 0x00, 0x62, 0x64, 0x08, 0x13, 0x23 },   // %
-    { 0x00, 0x36, 0x49, 0x55, 0x22, 0x50 },   // &
-    { 0x00, 0x00, 0x05, 0x03, 0x00, 0x00 },   // '
-    { 0x00, 0x00, 0x1c, 0x22, 0x41, 0x00 },   // (
-    { 0x00, 0x00, 0x41, 0x22, 0x1c, 0x00 },   // )
-    { 0x00, 0x14, 0x08, 0x3E, 0x08, 0x14 },   // *
-    { 0x00, 0x08, 0x08, 0x3E, 0x08, 0x08 },   // +
-    { 0x00, 0x00, 0x00, 0xA0, 0x60, 0x00 },   // ,
-    { 0x00, 0x08, 0x08, 0x08, 0x08, 0x08 },   // -
-    { 0x00, 0x00, 0x60, 0x60, 0x00, 0x00 },   // .
-    { 0x00, 0x20, 0x10, 0x08, 0x04, 0x02 },   // /
-    { 0x00, 0x3E, 0x51, 0x49, 0x45, 0x3E },   // 0
-    { 0x00, 0x00, 0x42, 0x7F, 0x40, 0x00 },   // 1
-    { 0x00, 0x42, 0x61, 0x51, 0x49, 0x46 },   // 2
-    { 0x00, 0x21, 0x41, 0x45, 0x4B, 0x31 },   // 3
-    { 0x00, 0x18, 0x14, 0x12, 0x7F, 0x10 },   // 4
-    { 0x00, 0x27, 0x45, 0x45, 0x45, 0x39 },   // 5
-    { 0x00, 0x3C, 0x4A, 0x49, 0x49, 0x30 },   // 6
-    { 0x00, 0x01, 0x71, 0x09, 0x05, 0x03 },   // 7
-    { 0x00, 0x36, 0x49, 0x49, 0x49, 0x36 },   // 8
-    { 0x00, 0x06, 0x49, 0x49, 0x29, 0x1E },   // 9
-    { 0x00, 0x00, 0x36, 0x36, 0x00, 0x00 },   // :
-    { 0x00, 0x00, 0x56, 0x36, 0x00, 0x00 },   // ;
-    { 0x00, 0x08, 0x14, 0x22, 0x41, 0x00 },   // <
-    { 0x00, 0x14, 0x14, 0x14, 0x14, 0x14 },   // =
-    { 0x00, 0x00, 0x41, 0x22, 0x14, 0x08 },   // >
-    { 0x00, 0x02, 0x01, 0x51, 0x09, 0x06 },   // ?
-    { 0x00, 0x32, 0x49, 0x59, 0x51, 0x3E },   // @
-    { 0x00, 0x7C, 0x12, 0x11, 0x12, 0x7C },   // A
-    { 0x00, 0x7F, 0x49, 0x49, 0x49, 0x36 },   // B
-    { 0x00, 0x3E, 0x41, 0x41, 0x41, 0x22 },   // C
-    { 0x00, 0x7F, 0x41, 0x41, 0x22, 0x1C },   // D
-    { 0x00, 0x7F, 0x49, 0x49, 0x49, 0x41 },   // E
-    { 0x00, 0x7F, 0x09, 0x09, 0x09, 0x01 },   // F
-    { 0x00, 0x3E, 0x41, 0x49, 0x49, 0x7A },   // G
-    { 0x00, 0x7F, 0x08, 0x08, 0x08, 0x7F },   // H
-    { 0x00, 0x00, 0x41, 0x7F, 0x41, 0x00 },   // I
-    { 0x00, 0x20, 0x40, 0x41, 0x3F, 0x01 },   // J
-    { 0x00, 0x7F, 0x08, 0x14, 0x22, 0x41 },   // K
-    { 0x00, 0x7F, 0x40, 0x40, 0x40, 0x40 },   // L
-    { 0x00, 0x7F, 0x02, 0x0C, 0x02, 0x7F },   // M
-    { 0x00, 0x7F, 0x04, 0x08, 0x10, 0x7F },   // N
-    { 0x00, 0x3E, 0x41, 0x41, 0x41, 0x3E },   // O
-    { 0x00, 0x7F, 0x09, 0x09, 0x09, 0x06 },   // P
-    { 0x00, 0x3E, 0x41, 0x51, 0x21, 0x5E },   // Q
-    { 0x00, 0x7F, 0x09, 0x19, 0x29, 0x46 },   // R
-    { 0x00, 0x46, 0x49, 0x49, 0x49, 0x31 },   // S
-    { 0x00, 0x01, 0x01, 0x7F, 0x01, 0x01 },   // T
-    { 0x00, 0x3F, 0x40, 0x40, 0x40, 0x3F },   // U
-    { 0x00, 0x1F, 0x20, 0x40, 0x20, 0x1F },   // V
-    { 0x00, 0x3F, 0x40, 0x38, 0x40, 0x3F },   // W
-    { 0x00, 0x63, 0x14, 0x08, 0x14, 0x63 },   // X
-    { 0x00, 0x07, 0x08, 0x70, 0x08, 0x07 },   // Y
-    { 0x00, 0x61, 0x51, 0x49, 0x45, 0x43 },   // Z
-    { 0x00, 0x00, 0x7F, 0x41, 0x41, 0x00 },   // [
-    { 0x00, 0x55, 0x2A, 0x55, 0x2A, 0x55 },   // 55
-    { 0x00, 0x00, 0x41, 0x41, 0x7F, 0x00 },   // ]
-    { 0x00, 0x04, 0x02, 0x01, 0x02, 0x04 },   // ^
-    { 0x00, 0x40, 0x40, 0x40, 0x40, 0x40 },   // _
-    { 0x00, 0x00, 0x01, 0x02, 0x04, 0x00 },   // '
-    { 0x00, 0x20, 0x54, 0x54, 0x54, 0x78 },   // a
-    { 0x00, 0x7F, 0x48, 0x44, 0x44, 0x38 },   // b
-    { 0x00, 0x38, 0x44, 0x44, 0x44, 0x20 },   // c
-    { 0x00, 0x38, 0x44, 0x44, 0x48, 0x7F },   // d
-    { 0x00, 0x38, 0x54, 0x54, 0x54, 0x18 },   // e
-    { 0x00, 0x08, 0x7E, 0x09, 0x01, 0x02 },   // f
-    { 0x00, 0x18, 0xA4, 0xA4, 0xA4, 0x7C },   // g
-    { 0x00, 0x7F, 0x08, 0x04, 0x04, 0x78 },   // h
-    { 0x00, 0x00, 0x44, 0x7D, 0x40, 0x00 },   // i
-    { 0x00, 0x40, 0x80, 0x84, 0x7D, 0x00 },   // j
-    { 0x00, 0x7F, 0x10, 0x28, 0x44, 0x00 },   // k
-    { 0x00, 0x00, 0x41, 0x7F, 0x40, 0x00 },   // l
-    { 0x00, 0x7C, 0x04, 0x18, 0x04, 0x78 },   // m
-    { 0x00, 0x7C, 0x08, 0x04, 0x04, 0x78 },   // n
-    { 0x00, 0x38, 0x44, 0x44, 0x44, 0x38 },   // o
-    { 0x00, 0xFC, 0x24, 0x24, 0x24, 0x18 },   // p
-    { 0x00, 0x18, 0x24, 0x24, 0x18, 0xFC },   // q
-    { 0x00, 0x7C, 0x08, 0x04, 0x04, 0x08 },   // r
-    { 0x00, 0x48, 0x54, 0x54, 0x54, 0x20 },   // s
-    { 0x00, 0x04, 0x3F, 0x44, 0x40, 0x20 },   // t
-    { 0x00, 0x3C, 0x40, 0x40, 0x20, 0x7C },   // u
-    { 0x00, 0x1C, 0x20, 0x40, 0x20, 0x1C },   // v
-    { 0x00, 0x3C, 0x40, 0x30, 0x40, 0x3C },   // w
-    { 0x00, 0x44, 0x28, 0x10, 0x28, 0x44 },   // x
-    { 0x00, 0x1C, 0xA0, 0xA0, 0xA0, 0x7C },   // y
-    { 0x00, 0x44, 0x64, 0x54, 0x4C, 0x44 },   // z
-    { 0x00,0x00, 0x06, 0x09, 0x09, 0x06 }    // horiz lines
-};
-
-
-
-
-void LCD_BIG_CHAR(unsigned char row, unsigned char col, unsigned char chr){
-
-    const char* f0;
-    const char* f;
-    unsigned char r, c, y;
-	unsigned char ch;
-   y = (chr & 0x0F);
-
-	if (y < 6)
-	f0 = Tahoma15x24 + y* 45;
-		else
-		f0 = Tahoma15x24_5 + (y - 6 )* 45;
-
-    for(r = 0; r<3; r++)
-    {
-        f = f0 + r;
-       LcdXY (col, (row +r));
-        for(c = 0; c<14; c++)
-        {
-            ch = *f;
-            LcdSend(LCD_D,ch);
-            f=f + 3;
+    for (;;) {
+        at=StrobeTarget();
+        ticks=at-TimeNow();
+        SIM_CYCLES(CY_ADD32+4);
+        if ((int32_t)ticks>STROBE_LATENCY) break;
+        if (!flashed) {
+            SIM_TRACE(SIM_TR_FLASH, at);
+            LED_FLASH(at);
+            flashed=1;
+        }
+        if (!StrobeFired()) {
+            // Nothing more to do until the next tach edge
+            TMR1IE=0;
+            TMR1ON=0;
+            return;
         }
     }
-}
-
 
-#define LED25uS     19
-#define LED50uS     38
-#define LED75uS     56
-#define LED100uS    75
-#define LED125uS    94
-#define LED150uS    113
-#define LED175uS    131
-#define LED200uS    150
-#define LED225uS    169
-#define LED250uS    188
-#define LED275uS    206
-#define LED300uS    225
-#define LED325uS    244
-#define LED340uS    256
+    // Timer1 counts up to the wrap and then it takes STROBE_LATENCY for
+    // the ISR to get the LED on
+    SIM_TRACE(SIM_TR_FLASH, at);
+    flashAt=at;
+    ticks-=STROBE_LATENCY;
+    flashOverflows=(uint16_t)(ticks>>16);
+    if (!(uint16_t)ticks) flashOverflows--;
+    ticks=0x10000-(uint16_t)ticks;
+    SIM_CYCLES(2*CY_ADD32+12);
+    TMR1ON=0;
+    TMR1H=(uint8_t)(ticks>>8);  // preset for timer1 MSB register
+    TMR1L=(uint8_t)ticks;       // preset for timer1 LSB register
+    TMR1IF=0;       // Clear Timer1 interrupt flag
+    TMR1IE=1;       // Enable Timer1 interrupt
+    TMR1ON=1;       // Enable Timer1 that turns on the LED
+}
 
 
 
 void interrupt ISR() {
-    static uint8_t rev=0;
-    static uint8_t led=0;
+    static uint32_t lastStamp;
+    static uint32_t stallAfter;
+    t_4bytes32 stamp;
+    uint32_t period, now;
+    uint16_t high;
+    uint8_t edge, kind, taken;
+#ifdef PROFILING
+    uint16_t began;
+#endif
+
+    // Timestamp the tach edge first thing, before any of the other work
+    // in here, so the time between the edge and this point is always the
+    // same fixed interrupt latency. The flag is checked before the timer
+    // is read so the edge can't come after the time it's stamped with.
+    edge=INT1IF;
+    stamp.u8.lowestByte=TMR0L;
+    stamp.u8.lowByte=TMR0H;     // Latched when TMR0L was read
+#ifdef PROFILING
+    ProfileEntry(stamp.u8.lowestByte|(uint16_t)stamp.u8.lowByte<<8,
+        edge+TMR0IF+(TMR1IF && TMR1IE)+(TMR2IF && TMR2IE));
+#endif
+
+    // Timer1 turns on the LED at the scheduled times. It's a one-shot that
+    // may need to wrap a number of times for long delays, and is set up
+    // again for the next flash of the revolution as soon as it fires.
+    if (TMR1IF && TMR1IE) {
+        PROFILE_START(began);
+        TMR1IF=0;       // Clear Timer1 interrupt flag
+        if (flashOverflows) {
+            flashOverflows--;
+        } else {
+            LED_FLASH(flashAt);
+            if (StrobeFired()) {
+                ArmFlash();
+            } else {
+                TMR1ON=0;
+                TMR1IE=0;
+            }
+        }
+        PROFILE_STOP(PROFILE_TIMER1, began);
+    }
+
+    high=tach_overflow;
+    // If Timer0 has wrapped but the overflow hasn't been counted yet, a
+    // small timer value means the wrap came before the timer was read
+    if (TMR0IF && !(stamp.u8.lowByte&0x80)) high++;
+    stamp.u8.highByte=(uint8_t)high;
+    stamp.u8.highestByte=(uint8_t)(high>>8);
 
-    // Timer0 is used to count the RPM of the motor
-    // At any decent speed it will overflow multiple times so
-    // we need to keep track of the number of overflows.
+    // Timer0 is the free running timebase, it overflows every 5.46ms
+    // so we need to keep track of the number of overflows.
     if (TMR0IF) {
+        PROFILE_START(began);
         tach_overflow++;
-            delay++;
         TMR0IF=0;       // Clear Timer0 interrupt flag
+        now=TimeNow();
+        // Get the flashes going once the strobe has been set to run free
+        if (!TMR1IE && StrobeFreeStart(now)) ArmFlash();
+        // No revolution for a good while, the motor has stopped. Tell the
+        // main loop and start measuring afresh from the next edge, rather
+        // than pass on a period with the standstill in it.
+        SIM_CYCLES(CY_ADD32+8);
+        if (tachValid && now-lastStamp>stallAfter) {
+            tachValid=0;
+            TachPush(0, now);
+            TachRestart();
+        }
+        PROFILE_STOP(PROFILE_TIMER0, began);
     }
 
     // HW Interrupt1 is connected to the tachometer to measure the 
     // speed of the motor.
-    if (INT1IF) {
-        if ((rev++) & 0x01) {
-            // We have a full revolution of the motor, so grab the
-            // values from Timer0 plus its overflow counter and stick
-            // them into a variable for the RPM display routine in the
-            // main function.
-            tachData.u8.lowestByte=TMR0L;
-            tachData.u8.lowByte=TMR0H;
-            TMR0H=0;
-            TMR0L=0;
-            tachData.u8.highByte=tach_overflow;
-            tach_overflow=0;
-            tachData.u8.highestByte=0;
-            // Tell the RPM calculator that new measurement data is availabe
-            newTachData=1;
-
-        LED=1;
-        // Start the timer for turning off the LED
-        TMR2=0;             // The timer should start from zero
-        TMR2IF=0;           // Clear Timer2 interupt flag
-        TMR2IE=1;           // Enable Timer2 interrupts
-            
-//            
-//            // Start delaying to turn on the LED
-//            TMR1H = delay>>8;    // preset for timer1 MSB register
-//            TMR1L = delay&0xFF;   // preset for timer1 LSB register
-//            TMR1IF=0;       // Clear Timer1 interrupt flag
-//            TMR1ON = 1;    // bit 0 = Enable Timer1 that turns on the LED
-         }
+    if (edge) {
+        PROFILE_START(began);
         INT1IF=0;       // Clear HW Interrupt 1 flag
+        // Bounces and spikes don't count as an edge
+        kind=TachBlank(stamp.u32);
+        // A flash right on the edge goes before all the sums, even before
+        // a revolution far off the last one is left out
+        if (tachValid && kind==TACH_END && StrobeAtEdge(stamp.u32)) {
+            SIM_TRACE(SIM_TR_FLASH, stamp.u32-STROBE_STAMPED);
+            LED_FLASH(stamp.u32-STROBE_STAMPED);
+        }
+        if (kind!=TACH_NOISE) kind=TachEdge(stamp.u32);
+        if (kind>=TACH_END) {
+            // We have a full revolution of the motor, the period is the
+            // difference between this timestamp and the one it started
+            // on, or where a lost edge should have been.
+            taken=tachValid && kind!=TACH_LEFTOUT;
+            period=TachRevolution(stamp.u32, taken);
+            lastStamp=stamp.u32;
+            SIM_CYCLES(CY_ADD32+8);
+            if (taken) {
+                // Bring the flash schedule back in phase with the motor,
+                // unless it's running free
+                if (StrobeEdge(stamp.u32, period)) ArmFlash();
+                // Queue the period up for the RPM display routine in the
+                // main function
+                TachPush(period, stamp.u32);
+                // A few times as long as this one is a stall
+                SIM_CYCLES(CY_SHIFT32+CY_ADD32*2+8);
+                if (period>TACH_MAXPERIOD>>TACH_STALLLOG2) stallAfter=TACH_MAXPERIOD;
+                else if (period<TACH_MINSTALL>>TACH_STALLLOG2) stallAfter=TACH_MINSTALL;
+                else stallAfter=period<<TACH_STALLLOG2;
+            } else if (!tachValid) {
+                // The first revolution can take up to the longest
+                stallAfter=TACH_MAXPERIOD;
+            }
+            tachValid=1;
+        }
+        PROFILE_STOP(PROFILE_INT1, began);
     }
 
-//    // Timer1 is used to turn on the LED after the desired delay
-//    if (TMR1IF) {
-//        // The turn on timer is a one-shot
-//        TMR1ON = 0;
-//        // Light up the led for the desired duration
-//        LED=1;
-//        // Start the timer for turning off the LED
-//        TMR2=0;             // The timer should start from zero
-//        TMR2IF=0;           // Clear Timer2 interupt flag
-//        TMR2IE=1;           // Enable Timer2 interrupts
-//
-//        TMR1IF=0;       // Clear Timer1 interrupt flag
-//    }
-
     // Timer2 is used to turn off the LED after the desired ON-time
     if (TMR2IF) {
+        PROFILE_START(began);
         LED=0;
+        if (TMR2IE) PulseOff();     // Count the on-time towards the power budget
         TMR2IE=0;       // Disable Timer2 now the LED is turned off
         TMR2IF=0;       // Clear Timer2 interrupt flag
+        PROFILE_STOP(PROFILE_TIMER2, began);
   }
+
+    // Timer3 is the alarm that wakes the main loop up from idle, it's done
+    // with once it has
+    if (TMR3IF) {
+        TMR3IF=0;
+        TMR3IE=0;
+    }
+    PROFILE_STOP(PROFILE_ISR, (uint16_t)stamp.u32);
 }
 
-#define AVGSIZE 32
+#define AVGLOG2 5   // Average the RPM over 2^5=32 revolutions
+#define FREEPULSE 24000UL   // Ticks between on-time updates running free, 2ms
 
 //
 //
@@ -480,11 +396,6 @@ void main(void) {
 
     LED_TRIS=0;
     LED=1;
-    SpiSetup();
-    LcdInit();
-    LcdClear();
-    LCD_BIG_CHAR(0, 0, 5);
-    LED=0;
 
     IPEN=0;
 
@@ -494,25 +405,17 @@ void main(void) {
     TMR0ON=1;	// Start TIMER0
     TMR0IE=1;	// Enable TIMER0 Interrupt
 
-//    //Timer1 Registers Prescaler= 1 - TMR1 Preset = 12662 - Freq = 0.23 Hz - Period = 4.406167 seconds
-//    T1CKPS1 = 0;   // bits 5-4  Prescaler Rate Select bits
-//    T1CKPS0 = 0;   // bit 4
-//    T1OSCEN = 1;   // bit 3 Timer1 Oscillator Enable Control bit 1 = on
-//    T1SYNC = 1;    // bit 2 Timer1 External Clock Input Synchronization Control bit...1 = Do not synchronize external clock input
-//    TMR1CS = 0;    // bit 1 Timer1 Clock Source Select bit...0 = Internal clock (FOSC/4)
-//    TMR1ON = 0;    // bit 0 = Disable timer
-//    TMR1IE=1;	   // Enable TIMER1 Interrupt
-//    delay=49*256+118;
-//    TMR1H = delay>>8;    // preset for timer1 MSB register
-//    TMR1L = delay&0xFF;   // preset for timer1 LSB register
-
+    // Timer1 is the one-shot that times the flashes
+    T1CON=0;
+    T1CKPS1 = 0;   // bits 5-4  Prescaler Rate Select bits
+    T1CKPS0 = 0;   // bit 4
+    TMR1CS = 0;    // bit 1 Timer1 Clock Source Select bit...0 = Internal clock (FOSC/4)
+    TMR1ON = 0;    // bit 0 = Disable timer until there's a flash to delay
+    TMR1IF=0;
+    TMR1IE=0;
 
-
-//    TMR3CS=0;   // Use clock from FCPU/4
-//    T3CKPS0=0;  // Prescale 1:1
-//    T3CKPS1=0;  // Prescale 1:1
-//    TMR3ON=1;	// Start TIMER0
-//    TMR3IE=1;	// Enable TIMER0 Interrupt
+    // Timer3 wakes the main loop from idle
+    PowerSetup();
 
 
     //
@@ -523,10 +426,21 @@ void main(void) {
     TMR2ON = 1;  // bit 2 turn timer2 on;
     T2CKPS1 = 1; // bits 1-0  Prescaler Rate Select bits
     T2CKPS0 = 0;
-    PR2=LED125uS;         // PR2 (Timer2 Match value)
+    PR2=0xFF;           // PR2 (Timer2 Match value), set for each flash by LED_FLASH()
     TMR2IF = 0;            // clear timer1 interupt flag TMR1IF
     TMR2IE = 0;         // disable Timer2 interrupts
 
+    // Only queued up here, the main loop sends it while it's waiting for
+    // the tach. The LCD needs Timer0 running to time its reset.
+    SpiSetup();
+    LcdInit();
+    LcdClear();
+    SettingsLoad();
+    MenuDraw();
+    InputSetup();
+    UsbSetup();
+    LED=0;
+
     INT1IE=1;   // Enable HW INT1 Interrupts
     INT1IF=0;
 
@@ -534,31 +448,168 @@ void main(void) {
     GIE=1;	// Enable INTs globally
 
 
-    uint32_t rpm,rpmTotal;
-    uint16_t rpmAvgArr[AVGSIZE];
+    uint16_t rpm, reading=0;
+    uint16_t shown;
+    uint8_t range=RPM_UNITS, shownRange, freeRange=RPM_UNITS;
     uint8_t avgPtr=0;
+    uint8_t newTachData;
+    t_tachSample sample;
+    t_inputEvent event;
+    uint8_t adjusted;
+    uint32_t interval, now, pulseAt=0, mrpm;
+    uint8_t pulseFree=0;
+    uint32_t quietFrom=0;
+    uint8_t stopped=1;
+#ifdef PROFILING
+    uint16_t pass, began;
+#endif
+
+    FilterSetup(FILTER_BOXCAR, AVGLOG2);
 
     for (;;) {
-
-        // If new readings are ready then process them
-        if (newTachData) {
-            newTachData=0;
-            rpmAvgArr[avgPtr]=(uint16_t)(1000.0/(((float)tachData.u32)/(12000.0*60.0)));
+        SIM_EVENT(SIM_EV_LOOP);
+#ifdef PROFILING
+        pass=ProfileNow();
+#endif
+
+        // Drain all the measurements the ISR has queued up since last
+        // time
+        newTachData=0;
+        while (TachPop(&sample)) {
+            if (!sample.period) {
+                // Stopped, show 0 rather than the last reading
+                reading=0;
+                range=RPM_UNITS;
+                FilterReset();
+                SettingsStopped();
+                TelemetryStop(sample.stamp);
+                stopped=1;
+                continue;
+            }
+            stopped=0;
+            // Readings in the units of another range don't average with
+            // the ones before
+            rpm=RpmFromPeriod(sample.period);
+            SettingsRevolution(sample.period);
+            shownRange=RpmRange(rpm, range);
+            if (shownRange!=range) {
+                range=shownRange;
+                FilterReset();
+            }
+            reading=FilterAdd(RpmScaled(sample.period, rpm, range));
+            TelemetryPeriod(sample.period, sample.stamp, reading, range);
             avgPtr++;
-            if (avgPtr>=AVGSIZE) avgPtr=0;
-            rpmTotal=0;
-            for (uint8_t i=0; i<AVGSIZE; i++) rpmTotal+=rpmAvgArr[i];
-            rpm=rpmTotal/AVGSIZE;
-            LCD_BIG_CHAR(0, 0*14, (rpm/10000)%10);
-            LCD_BIG_CHAR(0, 1*14, (rpm/1000)%10);
-            LCD_BIG_CHAR(0, 2*14, (rpm/100)%10);
-            LCD_BIG_CHAR(0, 3*14, (rpm/10)%10);
-            LCD_BIG_CHAR(0, 4*14, (rpm/1)%10);
-
-            LCD_BIG_CHAR(20, 0*14, (avgPtr/100)%10);
-            LCD_BIG_CHAR(20, 1*14, (avgPtr/10)%10);
-            LCD_BIG_CHAR(20, 2*14, (avgPtr/1)%10);
+            if (avgPtr>=(1<<AVGLOG2)) avgPtr=0;
+            newTachData=1;
+            SIM_EVENT(SIM_EV_SAMPLE);
         }
 
+        // Fit the LED on-time to the flash rate. Running free there is
+        // no tach to go by, the flashes come at the set interval, and the
+        // updates are timed on the main loop's clock instead of the
+        // tach stamps.
+        interval=StrobeGetInterval();
+        if ((interval!=0)!=pulseFree) {
+            pulseFree=interval!=0;
+            PulseRestart();
+        }
+        if (interval) {
+            now=LoopTime();
+            SIM_CYCLES(CY_ADD32+4);
+            if (now-pulseAt>=FREEPULSE) {
+                pulseAt=now;
+                PulseUpdate(interval*StrobeGetFlashes(), now);
+                SIM_CYCLES(CY_MUL32);
+            }
+        } else if (newTachData && sample.period) {
+            PulseUpdate(sample.period, sample.stamp);
+        }
+
+        // Settings changed with the knob and the buttons are shown right
+        // away, not at the next frame
+        InputPoll();
+        adjusted=0;
+        while (InputPop(&event)) {
+            MenuInput(&event);
+            adjusted=1;
+        }
+        if (adjusted) {
+            MenuDraw();
+            SettingsChanged();
+        }
+        SettingsPoll();
+
+        // Stream the periods and flashes out over USB if the port is open
+        UsbPoll();
+        TelemetryPoll();
+
+        // Redraw at the frame rate with the latest reading, however often
+        // the tach comes round
+        if (DisplayDue()) {
+            PROFILE_START(began);
+            shown=DisplayRpm(reading, range);
+            shownRange=range;
+            SIM_TRACE(SIM_TR_READING, (uint32_t)range<<16|shown);
+            SettingsReading(RpmWhole(shown, range));
+            // Running free it's the flash rate that's shown, in RPM it
+            // reads the speed of whatever it has frozen
+            if (interval) {
+                mrpm=StrobeGetFrequency()*60;
+                rpm=mrpm<1000UL*RPM_MAX ? (uint16_t)(mrpm/1000) : RPM_MAX;
+                freeRange=RpmRange(rpm, freeRange);
+                shown=RpmScaledMilli(mrpm, freeRange);
+                shownRange=freeRange;
+                SIM_CYCLES(CY_MUL32+CY_UDIV32+CY_ADD32);
+            }
+            SIM_EVENT(SIM_EV_FRAME);
+            LcdXY(0, 0);
+            LcdPrintUint16(shown, LCD_BIG|DisplayFormat(shownRange));
+            LcdXY(5*14+2, 2);
+            LcdString(shownRange==RPM_KILO ? "kRPM" : " RPM");
+            LcdXY(0, 4);
+            LcdPrintUint16(avgPtr, LCD_BIG|FORMAT_DIGITS(3));
+#ifdef PROFILING
+            // The readouts keep changing
+            if (MenuGetItem()==MENU_DIAG) MenuDraw();
+#endif
+            PROFILE_STOP(PROFILE_FRAME, began);
+        }
+
+        // Send a bit more of the display
+        PROFILE_START(began);
+        LcdPump();
+        PROFILE_STOP(PROFILE_PUMP, began);
+#ifdef PROFILING
+        // From the top of the pass to where it goes idle
+        ProfileAdd(PROFILE_LOOP, pass);
+#endif
+
+        // Stop the CPU until there's something to do, unless the LCD has
+        // more to come or a USB host wants its answers. Once the motor has
+        // stopped and nothing has been touched for a while, until a tach
+        // edge, a button or the USB with the display off. Otherwise until
+        // the next interrupt or input sample.
+        now=LoopTime();
+        if (!stopped || interval || adjusted || SettingsBusy()) quietFrom=now;
+        if (LcdBusy() || UsbAttached()) continue;
+        if (now-quietFrom<POWER_SLEEPAFTER) {
+            PowerIdle(InputDue());
+            continue;
+        }
+        LcdPower(0);
+        while (LcdBusy()) LcdPump();
+        GIE=0;          // What wakes it is dealt with here and not in the ISR
+        // Timer0 stops while it sleeps, a revolution going on would come
+        // out short by the time asleep. The tach starts afresh after it.
+        tachValid=0;
+        TachRestart();
+        InputWakeOn();
+        UsbWakeOn();
+        PowerSleep();
+        UsbWoken();
+        InputWoken();
+        GIE=1;
+        LcdPower(1);
+        quietFrom=LoopTime();
     }
 }
@@ -0,0 +1,174 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "strobe.h"
+#include "pulse.h"
+#include "format.h"
+#include "lcd.h"
+#include "profile.h"
+#include "menu.h"
+
+//
+// One setting at a time is up for adjusting and shown on the bottom line
+// of the LCD. OK or pushing the knob moves on to the next one, turning
+// the knob changes it by the encoder's steps and UP and DOWN by a single
+// step. The setters take effect on the next tach edge, or the next flash
+// running free, so the strobe keeps running while a setting is changed.
+//
+// The free running frequency steps by about a thousandth of itself, the
+// drift takes it the rest of the way to the mHz.
+//
+// A PROFILING build has one more item after the settings, where the knob
+// goes through the readouts of profile.c instead.
+//
+
+typedef struct {
+    const char *label;
+    const char *unit;
+    uint8_t type;               // FORMAT_DIGITS() and the rest
+    uint16_t step;
+    int32_t min;
+    int32_t max;
+} t_menuItem;
+
+static const t_menuItem items[MENU_ITEMS]={
+    { "Phs ", FONT_DEGREE " ", FORMAT_DIGITS(8)|FORMAT_BLANK, 1, 0, 359 },
+    { "Dly ", FONT_MICRO "s", FORMAT_DIGITS(8)|FORMAT_BLANK, 10, 0, 60000 },
+    { "Fls ", "x ", FORMAT_DIGITS(8)|FORMAT_BLANK, 1, 1, STROBE_MAXFLASHES },
+    { "Pw  ", FONT_MICRO "s", FORMAT_DIGITS(8)|FORMAT_BLANK, 5, 0, PULSE_MAXUS },
+    { "Frq ", "Hz", FORMAT_DIGITS(7)|FORMAT_DECIMALS(3)|FORMAT_BLANK, 10, 0, STROBE_MAXMHZ },
+    { "Dft ", "Hz", FORMAT_DIGITS(7)|FORMAT_DECIMALS(3)|FORMAT_BLANK, 1, -9999, 9999 },
+#ifdef PROFILING
+    { "", "", 0, 1, 0, PROFILE_READOUTS-1 },
+#endif
+};
+
+static uint8_t item;
+#ifdef PROFILING
+static uint8_t readout;
+#endif
+
+
+
+static int32_t Get(void) {
+    switch (item) {
+        case MENU_PHASE: return StrobeGetPhase();
+        case MENU_DELAY: return StrobeGetDelay();
+        case MENU_FLASHES: return StrobeGetFlashes();
+        case MENU_WIDTH: return PulseGetWidth();
+        case MENU_FREQUENCY: return (int32_t)StrobeGetFrequency();
+        default: return StrobeGetDrift();
+    }
+}
+
+
+
+//
+// Move the current setting by steps, the phase goes round, the rest
+// stop at the ends
+//
+static void Adjust(int8_t steps) {
+    const t_menuItem *m=&items[item];
+    int32_t v, step;
+
+#ifdef PROFILING
+    if (item==MENU_DIAG) {
+        // Round and round like the phase
+        readout=(uint8_t)((readout+steps%PROFILE_READOUTS+PROFILE_READOUTS)%PROFILE_READOUTS);
+        SIM_CYCLES(2*CY_UDIV8);
+        return;
+    }
+#endif
+    v=Get();
+    step=m->step;
+    if (item==MENU_FREQUENCY) {
+        // Below the lowest frequency is following the tach
+        if (!v) {
+            if (steps>0) StrobeSetFrequency(STROBE_MINMHZ);
+            return;
+        }
+        if (v>=100000) step=1000;
+        else if (v>=10000) step=100;
+    }
+    v+=steps*step;
+    SIM_CYCLES(CY_MUL16+CY_ADD32*3+12);
+    if (item==MENU_PHASE) {
+        while (v<0) v+=360;
+        while (v>=360) v-=360;
+    } else if (v<m->min) {
+        v=m->min;
+    } else if (v>m->max) {
+        v=m->max;
+    }
+    switch (item) {
+        case MENU_PHASE: StrobeSetPhase((uint16_t)v); break;
+        case MENU_DELAY: StrobeSetDelay((uint16_t)v); break;
+        case MENU_FLASHES: StrobeSetFlashes((uint8_t)v); break;
+        case MENU_WIDTH: PulseSetWidth((uint16_t)v); break;
+        case MENU_FREQUENCY:
+            StrobeSetFrequency(v<(int32_t)STROBE_MINMHZ ? 0 : (uint32_t)v);
+            break;
+        default: StrobeSetDrift((int16_t)v); break;
+    }
+}
+
+
+
+//
+// Act on an event from the input queue
+//
+void MenuInput(const t_inputEvent *event) {
+    SIM_CYCLES(CY_CALL+8);
+    switch (event->what) {
+        case INPUT_OK:
+        case INPUT_PUSH:
+            if (++item>=MENU_ITEMS) item=0;
+            break;
+        case INPUT_UP: Adjust(1); break;
+        case INPUT_DOWN: Adjust(-1); break;
+        case INPUT_TURN: Adjust(event->steps); break;
+    }
+}
+
+
+
+//
+// Show the setting being adjusted, the LCD's shadow leaves out whatever
+// hasn't changed. Every setting takes up the same width so none of one
+// is left over next to another.
+//
+void MenuDraw(void) {
+    const t_menuItem *m=&items[item];
+    char buf[FORMAT_MAXLEN];
+    int32_t v=Get();
+    uint8_t i;
+
+    LcdXY(0, MENU_PAGE);
+#ifdef PROFILING
+    if (item==MENU_DIAG) {
+        ProfileDraw(readout);
+        return;
+    }
+#endif
+    LcdString(m->label);
+    if (item==MENU_WIDTH && !v) {
+        LcdString("     max");  // As long as the duty cycle allows
+    } else if (item==MENU_FREQUENCY && !v) {
+        LcdString("    tach");
+    } else {
+        FormatUint32(buf, (uint32_t)(v<0 ? -v : v), m->type);
+        if (item==MENU_DRIFT) {
+            // The sign goes in the blank before the digits
+            for (i=1; buf[i]==' '; i++) SIM_CYCLES(4);
+            buf[i-1]=v<0 ? '-' : '+';
+        }
+        LcdString(buf);
+    }
+    LcdString(m->unit);
+}
+
+
+
+uint8_t MenuGetItem(void) {
+    return item;
+}
@@ -0,0 +1,31 @@
+//
+// Adjusting the strobe settings with the encoder and the buttons
+//
+
+#ifndef MENU_H
+#define MENU_H
+
+#include <stdint.h>
+#include "input.h"
+
+#define MENU_PAGE       7       // LCD page the setting being adjusted is shown on
+
+// Settings in the order OK steps through them
+#define MENU_PHASE      0
+#define MENU_DELAY      1
+#define MENU_FLASHES    2
+#define MENU_WIDTH      3
+#define MENU_FREQUENCY  4
+#define MENU_DRIFT      5
+#ifdef PROFILING
+#define MENU_DIAG       6       // Not a setting, the readouts of profile.c
+#define MENU_ITEMS      7
+#else
+#define MENU_ITEMS      6
+#endif
+
+void MenuInput(const t_inputEvent *event);
+void MenuDraw(void);
+uint8_t MenuGetItem(void);
+
+#endif
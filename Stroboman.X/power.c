@@ -0,0 +1,79 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "power.h"
+
+//
+// The main loop spends most of its passes finding nothing to do, so at
+// the end of one that has nothing left for the LCD it puts the CPU in
+// idle mode instead of coming straight round again. The clock keeps
+// running for the timers, the MSSP and the USB, only the CPU stops, and
+// any interrupt wakes it with the usual latency. The ISR runs as soon as
+// it does and the main loop carries on after SLEEP. A tach edge or a
+// flash is served as quickly as it would be with the CPU busy.
+//
+// The main loop also does things on Timer0 time that no interrupt comes
+// for, sampling the inputs most often. Timer3 is the alarm for those: it
+// is loaded with the ticks until the next one is due and wakes the CPU
+// when it wraps. The ISR only has to turn it off.
+//
+// Timer0 keeps wrapping every 5.46ms in idle, it's the timebase all of
+// that is timed on. With the motor stopped and nobody at the controls it
+// isn't needed, and the chip goes to sleep: the oscillator stops, and
+// Timer0 with it, until a tach edge on INT1, a button's change on port B
+// or activity on the USB wakes it. The timebase then carries on from
+// where it stopped. The crystal and the PLL take about 2ms to start up
+// again, the edge that woke it would be stamped that much late, so it's
+// dropped; the motor was stopped and the tach starts measuring afresh
+// from the next one anyway.
+//
+// Only the CPU clock is stopped, it isn't slowed down: Timer0 and the USB
+// both run off the 48MHz clock, and the timebase has to keep its rate.
+//
+
+
+
+//
+// Set up Timer3, 1:1 from the instruction clock like Timer0 and stopped
+// until there's a wait to time
+//
+void PowerSetup(void) {
+    T3CON=0;
+    TMR3IF=0;
+    TMR3IE=0;
+    OSCCONbits.IDLEN=1;     // SLEEP only stops the CPU, not the oscillator
+}
+
+
+
+//
+// Stop the CPU until the next interrupt, or for at most the given Timer0
+// ticks
+//
+void PowerIdle(uint16_t ticks) {
+    SIM_CYCLES(CY_CALL+4);
+    if (ticks<POWER_MINIDLE) return;
+    ticks=0-ticks;              // Timer3 counts up to the wrap
+    TMR3H=(uint8_t)(ticks>>8);
+    TMR3L=(uint8_t)ticks;
+    TMR3IF=0;
+    TMR3IE=1;
+    TMR3ON=1;
+    SLEEP();
+    TMR3ON=0;
+    TMR3IE=0;
+}
+
+
+
+//
+// Stop the oscillator until a tach edge, an interrupt-on-change or the
+// USB, which the caller has to have set up. The interrupts have to be
+// off, so that what woke it is left to the caller and not the ISR.
+//
+void PowerSleep(void) {
+    OSCCONbits.IDLEN=0;
+    SLEEP();
+    OSCCONbits.IDLEN=1;
+    INT1IF=0;                   // The edge that woke it, a start-up late
+}
@@ -0,0 +1,17 @@
+//
+// Idle and sleep, the CPU stopped while there's nothing for it to do
+//
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+#define POWER_MINIDLE   200             // Timer0 ticks, any less to wait isn't worth going idle for
+#define POWER_SLEEPAFTER 360000000UL    // Timer0 ticks stopped and untouched before it sleeps, 30s
+
+void PowerSetup(void);
+void PowerIdle(uint16_t ticks);
+void PowerSleep(void);
+
+#endif
@@ -0,0 +1,149 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "format.h"
+#include "lcd.h"
+#include "profile.h"
+
+//
+// Timer0 runs at the instruction clock, so the difference of its low 16
+// bits between the start and the end of a piece of code is the number of
+// cycles it took, ISRs included, as long as that's under 65536. The ISR
+// already reads it first thing for the tach stamp; the branches read it
+// again at their start, PROFILE_START(), and ProfileAdd() reads it at the
+// end. The main loop's slots do the same. Each slot keeps the shortest
+// and the longest time there has been and a histogram in powers of two,
+// for a debugger to read out or for the simulator to export. The counts
+// stop at 65535, the ISR slots are only written by the ISR and the main
+// loop ones by the main loop.
+//
+// There is a single interrupt priority, so the ISR can't interrupt itself.
+// What it can do is find several sources pending at once, which makes
+// some of them wait for the others, or be entered again straight after it
+// returns, which holds up the main loop for both. Both are counted.
+//
+// The timing costs a few cycles of its own: about 30 for each slot, and
+// for the ISR the flags it looks at on the way in. The flash on Timer1 is
+// that much later in a PROFILING build.
+//
+
+#ifdef PROFILING
+
+// The diagnostics line, one readout at a time picked with the knob
+static const char *const labels[PROFILE_READOUTS]={
+    "ISR ", "T1  ", "T0  ", "INT ", "T2  ", "Loop", "Frm ", "Lcd ", "Col ", "Chn ",
+};
+
+static volatile t_profile slots[PROFILE_SLOTS]={
+    { 0xFFFF }, { 0xFFFF }, { 0xFFFF }, { 0xFFFF },
+    { 0xFFFF }, { 0xFFFF }, { 0xFFFF }, { 0xFFFF },
+};
+
+static uint16_t lastExit;
+static uint8_t entered;         // There's been an ISR to follow on from
+static volatile uint16_t collided;
+static volatile uint16_t chained;
+
+
+
+//
+// Called first thing in the ISR, with the time it was entered and the
+// number of interrupt sources pending
+//
+void ProfileEntry(uint16_t at, uint8_t sources) {
+    SIM_CYCLES(CY_CALL+12);
+    if (sources>1 && collided!=0xFFFF) collided++;
+    if (entered && (uint16_t)(at-lastExit)<PROFILE_CHAIN && chained!=0xFFFF) chained++;
+    entered=1;
+}
+
+
+
+//
+// Timer0's low 16 bits. An ISR reading TMR0L between the two reads would
+// latch another TMR0H, and the time would be off by up to 256 ticks or
+// even run backwards, so the interrupts are held off for them. In the ISR
+// GIE is already clear and stays so.
+//
+uint16_t ProfileNow(void) {
+    uint16_t now;
+    uint8_t gie=GIE;
+
+    GIE=0;
+    now=TMR0L;
+    now|=(uint16_t)TMR0H<<8;    // Latched when TMR0L was read
+    GIE=gie;
+    SIM_CYCLES(CY_CALL+8);
+    return now;
+}
+
+
+
+//
+// A slot's code has run from start until now
+//
+void ProfileAdd(uint8_t slot, uint16_t start) {
+    volatile t_profile *p=&slots[slot];
+    uint16_t now, ticks, high;
+    uint8_t b;
+
+    now=ProfileNow();
+    ticks=now-start;
+    if (slot==PROFILE_ISR) lastExit=now;
+    if (ticks<p->min) p->min=ticks;
+    if (ticks>p->max) p->max=ticks;
+    // The bucket is the top bit set above the first one
+    high=ticks>>PROFILE_FIRSTLOG2;
+    for (b=0; high && b<PROFILE_BUCKETS-1; b++) high>>=1;
+    if (p->count[b]!=0xFFFF) p->count[b]++;
+    SIM_CYCLES(CY_CALL+b*4+34);
+}
+
+
+
+//
+// The record of a slot. The ISR's may change under the main loop while
+// it's being read.
+//
+const volatile t_profile *ProfileGet(uint8_t slot) {
+    return &slots[slot];
+}
+
+uint16_t ProfileCollided(void) {
+    return collided;
+}
+
+uint16_t ProfileChained(void) {
+    return chained;
+}
+
+
+
+//
+// Show one of the readouts on the bottom line of the LCD, the longest
+// time a slot took in us or one of the counts
+//
+void ProfileDraw(uint8_t readout) {
+    uint16_t v;
+
+    LcdString(labels[readout]);
+    if (readout>=PROFILE_SLOTS) {
+        // Read until two reads agree in case the ISR updated it halfway
+        do {
+            v=readout==PROFILE_COLLIDED ? collided : chained;
+        } while (v!=(readout==PROFILE_COLLIDED ? collided : chained));
+        LcdPrintUint16(v, FORMAT_DIGITS(8)|FORMAT_BLANK);
+        LcdString("x ");
+        return;
+    }
+    do {
+        v=slots[readout].max;
+    } while (v!=slots[readout].max);
+    // Ticks to tenths of a us, *10/12
+    v=slots[readout].min==0xFFFF ? 0 : (uint16_t)(((uint32_t)v*54613)>>16);
+    SIM_CYCLES(CY_MUL32+12);
+    LcdPrintUint16(v, FORMAT_DIGITS(7)|FORMAT_DECIMALS(1)|FORMAT_BLANK);
+    LcdString(FONT_MICRO "s");
+}
+
+#endif
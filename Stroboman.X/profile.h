@@ -0,0 +1,53 @@
+//
+// Cycle budget of the ISR and the main loop, timed on Timer0. Only built
+// in with PROFILING defined, otherwise the hooks compile to nothing.
+//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+// What is timed
+#define PROFILE_ISR     0       // All of the ISR, from the tach stamp to the end
+#define PROFILE_TIMER1  1       // Flash
+#define PROFILE_TIMER0  2       // Timebase wrap, starting the strobe running free and stalls
+#define PROFILE_INT1    3       // Tach edge
+#define PROFILE_TIMER2  4       // LED off
+#define PROFILE_LOOP    5       // A pass of the main loop, with any ISRs in it
+#define PROFILE_FRAME   6       // Drawing a frame into the LCD's shadow
+#define PROFILE_PUMP    7       // LcdPump(), sending it
+#define PROFILE_SLOTS   8
+
+// The readouts of the diagnostics line, the slots and then the counts
+#define PROFILE_COLLIDED PROFILE_SLOTS      // ISRs that found more than one source pending
+#define PROFILE_CHAINED (PROFILE_SLOTS+1)   // and that came straight after the last one
+#define PROFILE_READOUTS (PROFILE_SLOTS+2)
+
+#define PROFILE_BUCKETS 8       // Of the histogram, a power of two of Timer0 ticks each
+#define PROFILE_FIRSTLOG2 6     // The first is under 64 ticks, the last 4096 and over
+#define PROFILE_CHAIN   64      // Ticks after the ISR an entry counts as chained
+
+typedef struct {
+    uint16_t min;
+    uint16_t max;
+    uint16_t count[PROFILE_BUCKETS];    // Each stops at 65535
+} t_profile;
+
+#ifdef PROFILING
+#define PROFILE_START(t)        ((t)=ProfileNow())
+#define PROFILE_STOP(slot, t)   ProfileAdd(slot, t)
+#else
+#define PROFILE_START(t)
+#define PROFILE_STOP(slot, t)
+#endif
+
+uint16_t ProfileNow(void);
+void ProfileEntry(uint16_t at, uint8_t sources);
+void ProfileAdd(uint8_t slot, uint16_t start);
+const volatile t_profile *ProfileGet(uint8_t slot);
+uint16_t ProfileCollided(void);
+uint16_t ProfileChained(void);
+void ProfileDraw(uint8_t readout);
+
+#endif
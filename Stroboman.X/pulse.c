@@ -0,0 +1,196 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "strobe.h"
+#include "pulse.h"
+
+//
+// Timer2 turns the LED off again, PR2 is loaded with the on-time for each
+// flash. The on-time is worked out by the main loop once per revolution
+// from the measured period: a flash may take up the duty cycle limit of
+// the time until the next one, so pulses get longer at low flash rates
+// and shorter at high ones. A width of zero asks for as long as the limit
+// allows, anything else is the most that's wanted for a sharper image.
+//
+// The prediction can be off, edges can be noisy or the schedule can be
+// coasting, and the ISR may be too busy to turn the LED off right when
+// Timer2 says so. The on-time the LED has really had is timed on Timer0
+// from PulseOn() to PulseOff() and goes into a bucket that drains at the
+// rate the duty cycle allows, and when more than PULSE_BURST has piled up
+// the pulses are cut down to the shortest Timer2 can do until it has
+// drained again. Should that still be too much, at very high flash rates,
+// flashes are left out altogether until the bucket is back under
+// PULSE_BURST.
+//
+
+static uint16_t widthUs=PULSE_WIDTH;
+static uint16_t dutyPermille=PULSE_DUTY;
+static uint8_t width=PULSE_TICKS(PULSE_WIDTH);      // Timer2 ticks, 0 for the longest
+static uint16_t duty=(uint16_t)(PULSE_DUTY*65536UL/1000);   // 1/65536ths
+static volatile uint8_t pr=PULSE_TICKS(PULSE_WIDTH)-1;
+static volatile uint32_t onTicks;       // Total time the LED has been on
+volatile uint8_t pulseHold;
+
+// Only used from the ISR
+static uint16_t onAt;
+
+// Only used from the main loop
+static uint16_t perFlash;               // Duty cycle for each of the flashes
+static uint8_t flashes;
+static uint32_t lastOn;
+static uint32_t lastStamp;
+static uint32_t bucket;
+static uint8_t primed;
+static uint8_t timed;                   // lastStamp is on the same clock as the next
+static uint8_t limited;
+
+
+
+//
+// x*f/65536 without needing a 48 bit product
+//
+static uint32_t Fraction(uint32_t x, uint16_t f) {
+    uint32_t r;
+
+    r=(uint32_t)(uint16_t)(x>>16)*f;
+    r+=((uint32_t)(uint16_t)x*f)>>16;
+    SIM_CYCLES(CY_CALL+2*CY_MUL16+CY_ADD32+8);
+    return r;
+}
+
+
+
+//
+// Set the on-time in us, 0 for as long as the duty cycle limit allows
+//
+void PulseSetWidth(uint16_t us) {
+    if (us>PULSE_MAXUS) us=PULSE_MAXUS;
+    widthUs=us;
+    width=(uint8_t)PULSE_TICKS(us);
+    if (us && !width) width=1;
+    SIM_CYCLES(CY_MUL16+8);
+}
+
+
+
+//
+// Set the average duty cycle limit in 1/1000ths
+//
+void PulseSetDuty(uint16_t permille) {
+    if (permille<1) permille=1;
+    if (permille>999) permille=999;
+    dutyPermille=permille;
+    duty=(uint16_t)(((uint32_t)permille<<16)/1000);
+    flashes=0;      // Work out perFlash again
+    SIM_CYCLES(CY_UDIV32);
+}
+
+
+
+uint16_t PulseGetWidth(void) {
+    return widthUs;
+}
+
+uint16_t PulseGetDuty(void) {
+    return dutyPermille;
+}
+
+uint8_t PulseLimited(void) {
+    return limited;
+}
+
+//
+// The on-time currently in use, in us
+//
+uint16_t PulseGetActual(void) {
+    return (uint16_t)(((uint16_t)pr+1)*4/3);
+}
+
+
+
+//
+// Called from the main loop with the latest revolution period and the
+// time it ended at. Keeps the power budget and sets up the on-time for
+// the flashes to come.
+//
+void PulseUpdate(uint32_t period, uint32_t stamp) {
+    uint32_t on, allowed, most;
+    uint16_t ticks;
+    uint8_t f;
+
+    // Take what the LED has been on for since last time, less what the
+    // limit allows for the time that has passed, into the bucket
+    do {
+        on=onTicks;
+    } while (on!=onTicks);
+    if (primed) {
+        bucket+=on-lastOn;
+        if (timed) {
+            allowed=Fraction(stamp-lastStamp, duty);
+            bucket=bucket>allowed ? bucket-allowed : 0;
+        }
+        SIM_CYCLES(6*CY_ADD32+12);
+        if (bucket>PULSE_BURST) limited=1;
+        if (bucket>2*PULSE_BURST) pulseHold=1;
+        if (bucket<PULSE_BURST) pulseHold=0;
+        if (!bucket) limited=0;
+    }
+    primed=1;
+    timed=1;
+    lastOn=on;
+    lastStamp=stamp;
+
+    // Share the limit out between the flashes of a revolution
+    f=StrobeGetFlashes();
+    if (f!=flashes) {
+        flashes=f;
+        perFlash=duty/f;
+        SIM_CYCLES(CY_UDIV16);
+    }
+
+    // The longest pulse the limit allows at this rate, in Timer2 ticks
+    most=Fraction(period, perFlash)/PULSE_TICK;
+    ticks=most>256 ? 256 : (uint16_t)most;
+    if (width && width<ticks) ticks=width;
+    if (limited || !ticks) ticks=1;
+    SIM_CYCLES(CY_SHIFT32*4+3*CY_ADD32+8);
+    pr=(uint8_t)(ticks-1);
+}
+
+
+
+//
+// The next update is timed on another clock than the last, the tach
+// stamps or the main loop's time. The on-time in between still goes into
+// the bucket, but nothing drains from it until the update after.
+//
+void PulseRestart(void) {
+    timed=0;
+}
+
+
+
+//
+// Called from the ISR right after the LED goes on, returns the value for
+// PR2
+//
+uint8_t PulseOn(void) {
+    SIM_CYCLES(CY_CALL+6);
+    onAt=TMR0L;
+    onAt|=(uint16_t)TMR0H<<8;   // Latched when TMR0L was read
+    return pr;
+}
+
+
+
+//
+// Called from the ISR right after the LED goes off
+//
+void PulseOff(void) {
+    uint16_t now;
+
+    now=TMR0L;
+    now|=(uint16_t)TMR0H<<8;
+    onTicks+=(uint16_t)(now-onAt);
+    SIM_CYCLES(CY_CALL+CY_ADD32+12);
+}
@@ -0,0 +1,34 @@
+//
+// LED on-time, traded against the flash rate and the average power
+//
+
+#ifndef PULSE_H
+#define PULSE_H
+
+#include <stdint.h>
+
+#define PULSE_TICK      16      // Timer0 ticks per Timer2 tick, the 1:16 prescaler
+#define PULSE_MAXUS     340     // Longest pulse Timer2 can time
+#define PULSE_WIDTH     125     // Default on-time in us
+#define PULSE_DUTY      50      // Default average duty cycle limit in 1/1000ths
+#define PULSE_BURST     60000UL // Ticks of on-time over the limit before cutting back
+
+// Microseconds to Timer2 ticks of 4/3 us
+#define PULSE_TICKS(us) ((uint16_t)(((us)*3UL+2)/4))
+
+// Set when even the shortest pulses are over the limit and flashes have
+// to be left out. LED_FLASH() tests it inline, a call would add latency.
+extern volatile uint8_t pulseHold;
+
+void PulseSetWidth(uint16_t us);
+void PulseSetDuty(uint16_t permille);
+uint16_t PulseGetWidth(void);
+uint16_t PulseGetDuty(void);
+uint16_t PulseGetActual(void);
+uint8_t PulseLimited(void);
+void PulseUpdate(uint32_t period, uint32_t stamp);
+void PulseRestart(void);
+uint8_t PulseOn(void);
+void PulseOff(void);
+
+#endif
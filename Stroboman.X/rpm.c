@@ -0,0 +1,195 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "rpm.h"
+
+//
+// The PIC has no FPU and no divide instruction, so instead of dividing
+// RPM_CONSTANT by the period we multiply it with the reciprocal of the
+// period. The period is normalized to a 16 bit mantissa, the top bits of
+// the mantissa pick a seed from the table below that is good to about
+// 8 bits, and a single Newton-Raphson step brings that to about 14 bits.
+// Every step rounds towards zero so the estimated RPM is never too high,
+// and a final remainder check walks it up to the exact quotient. The
+// result is floor(RPM_CONSTANT/ticks), identical to what the float
+// calculation gave except where the float rounding came out one low.
+//
+// Whole RPM are too coarse at a few RPM and don't go past 65535, so
+// readings come in ranges instead, each with four or five significant
+// digits. Below 1000 RPM the decimals are carried on from the remainder
+// of the division, a divide each, but there are at most 16 revolutions
+// a second to do that for. Above 65535 RPM the period is short enough to
+// be multiplied by 100 and put through the reciprocal again. A reading
+// changes range a few percent past the edge of the one it's in so it
+// doesn't flip back and forth at the edge.
+//
+
+#define RECIPROCAL_SHIFT    14
+#define RPM_CONSTANT_HI     ((uint16_t)(RPM_CONSTANT>>RECIPROCAL_SHIFT))
+
+// 2^23/(i+1) for i=128..255, i being the top 8 bits of the mantissa
+static const uint16_t reciprocalSeed[128] = {
+    65027, 64527, 64035, 63550, 63072, 62601, 62137, 61680,
+    61230, 60787, 60349, 59918, 59493, 59074, 58661, 58254,
+    57852, 57456, 57065, 56679, 56299, 55924, 55553, 55188,
+    54827, 54471, 54120, 53773, 53430, 53092, 52758, 52428,
+    52103, 51781, 51463, 51150, 50840, 50533, 50231, 49932,
+    49636, 49344, 49056, 48770, 48489, 48210, 47934, 47662,
+    47393, 47127, 46863, 46603, 46345, 46091, 45839, 45590,
+    45343, 45100, 44858, 44620, 44384, 44150, 43919, 43690,
+    43464, 43240, 43018, 42799, 42581, 42366, 42153, 41943,
+    41734, 41527, 41323, 41120, 40920, 40721, 40524, 40329,
+    40136, 39945, 39756, 39568, 39383, 39199, 39016, 38836,
+    38657, 38479, 38304, 38130, 37957, 37786, 37617, 37449,
+    37282, 37117, 36954, 36792, 36631, 36472, 36314, 36157,
+    36002, 35848, 35696, 35544, 35394, 35246, 35098, 34952,
+    34807, 34663, 34521, 34379, 34239, 34100, 33961, 33825,
+    33689, 33554, 33420, 33288, 33156, 33026, 32896, 32768,
+};
+
+// RPM that take a reading up a range, and down
+static const uint16_t rangeUp[RPM_RANGES-1]={ 10, 100, 1000, RPM_MAX };
+static const uint16_t rangeDown[RPM_RANGES]={ 0, 9, 95, 950, 62000 };
+
+// 1/1000 RPM in each range's units
+static const uint32_t rangeMilli[RPM_RANGES]={ 1, 10, 100, 1000, 100000 };
+
+
+
+//
+// Convert a period in Timer0 ticks per revolution into RPM. Periods too
+// short to fit the result in 16 bits return RPM_MAX, a zero period too.
+//
+uint16_t RpmFromPeriod(uint32_t ticks) {
+    uint32_t n, mant, r, p, rem;
+    uint16_t q;
+    uint8_t sh;
+
+    SIM_CYCLES(CY_CALL+2*CY_ADD32);
+    if (ticks<=RPM_CONSTANT/(RPM_MAX+1UL)) return RPM_MAX;
+    if (ticks>RPM_CONSTANT) return 0;
+
+    // Normalize so that bit 31 is set, whole bytes first
+    n=ticks;
+    sh=0;
+    while (!(n&0xFF000000UL)) {
+        SIM_CYCLES(10);
+        n<<=8;
+        sh+=8;
+    }
+    while (!(n&0x80000000UL)) {
+        SIM_CYCLES(CY_SHIFT32+4);
+        n<<=1;
+        sh++;
+    }
+
+    // Round the mantissa up so the reciprocal can only be underestimated,
+    // then r ~ 2^32/mant from the seed table plus one Newton-Raphson step
+    mant=(n>>16)+1;
+    r=(uint32_t)reciprocalSeed[(uint8_t)(n>>24)-128]<<1;
+    p=0-mant*r;
+    r+=((r>>1)*(uint16_t)(p>>9))>>22;
+    SIM_CYCLES(CY_ADD32+CY_TBLRD*2+CY_MUL32+2*CY_MUL16+CY_ADD32+16);
+
+    // RPM ~ RPM_CONSTANT/ticks = RPM_CONSTANT * r / 2^(48-sh)
+    p=(uint32_t)RPM_CONSTANT_HI*(uint16_t)(r>>1);
+    sh=33-sh;
+    SIM_CYCLES(4);
+    if (sh>=32) {
+        q=0;
+    } else {
+        if (sh>=16) {
+            p>>=16;
+            sh-=16;
+            SIM_CYCLES(4);
+        }
+        SIM_CYCLES(sh*CY_SHIFT32);
+        q=(uint16_t)(p>>sh);
+    }
+
+    // The estimate is at most a few counts low, fix it up exactly
+    rem=RPM_CONSTANT-(uint32_t)q*ticks;
+    SIM_CYCLES(CY_MUL32+CY_ADD32);
+    while (rem>=ticks) {
+        SIM_CYCLES(2*CY_ADD32+4);
+        rem-=ticks;
+        q++;
+    }
+    return q;
+}
+
+
+
+//
+// The range for a reading of rpm whole RPM, as RpmFromPeriod() gave it,
+// that was in range before
+//
+uint8_t RpmRange(uint16_t rpm, uint8_t range) {
+    SIM_CYCLES(CY_CALL+4);
+    while (range<RPM_KILO && rpm>=rangeUp[range]) {
+        range++;
+        SIM_CYCLES(CY_TBLRD+8);
+    }
+    while (range>RPM_MILLI && rpm<rangeDown[range]) {
+        range--;
+        SIM_CYCLES(CY_TBLRD+8);
+    }
+    return range;
+}
+
+
+
+//
+// The reading for a period in the units of range, rpm is what
+// RpmFromPeriod() gave for it. Values too big for the range come out as
+// 0xFFFF.
+//
+uint16_t RpmScaled(uint32_t ticks, uint16_t rpm, uint8_t range) {
+    uint32_t q, rem;
+    uint8_t d;
+
+    SIM_CYCLES(CY_CALL+4);
+    if (range==RPM_UNITS) return rpm;
+    if (range==RPM_KILO) {
+        // Periods this short are far from overflowing when multiplied
+        SIM_CYCLES(CY_MUL32);
+        return RpmFromPeriod(ticks*100);
+    }
+
+    // One more digit from the remainder for each decimal, the remainder
+    // times ten fits as long as the period is under 2^32/10
+    if (ticks>0xFFFFFFFFUL/10) return 0;
+    q=rpm;
+    rem=RPM_CONSTANT-q*ticks;
+    SIM_CYCLES(CY_MUL32+CY_ADD32);
+    for (d=range; d<RPM_UNITS; d++) {
+        rem*=10;
+        q=q*10+rem/ticks;
+        rem%=ticks;
+        SIM_CYCLES(2*CY_MUL32+2*CY_UDIV32);
+    }
+    return q>0xFFFF ? 0xFFFF : (uint16_t)q;
+}
+
+
+
+//
+// A reading in 1/1000 RPM in the units of range
+//
+uint16_t RpmScaledMilli(uint32_t mrpm, uint8_t range) {
+    mrpm/=rangeMilli[range];
+    SIM_CYCLES(CY_CALL+CY_TBLRD*4+CY_UDIV32);
+    return mrpm>0xFFFF ? 0xFFFF : (uint16_t)mrpm;
+}
+
+
+
+//
+// A reading in the units of range back to whole RPM
+//
+uint32_t RpmWhole(uint16_t reading, uint8_t range) {
+    SIM_CYCLES(CY_CALL+4);
+    if (range==RPM_UNITS) return reading;
+    SIM_CYCLES(CY_TBLRD*4+CY_MUL32+CY_UDIV32);
+    return (uint32_t)reading*rangeMilli[range]/1000;
+}
@@ -0,0 +1,28 @@
+//
+// Period to RPM conversion without floating point
+//
+
+#ifndef RPM_H
+#define RPM_H
+
+#include <stdint.h>
+
+#define TACH_CLOCK      12000000UL              // Timer0 ticks per second (FCPU/4)
+#define RPM_CONSTANT    (TACH_CLOCK*60UL)       // RPM = RPM_CONSTANT / ticks per revolution
+#define RPM_MAX         0xFFFF
+
+// Ranges of readings, each with four or five significant digits
+#define RPM_MILLI       0       // Under 10 RPM, in 1/1000 RPM
+#define RPM_CENTI       1       // Under 100 RPM, in 1/100 RPM
+#define RPM_DECI        2       // Under 1000 RPM, in 1/10 RPM
+#define RPM_UNITS       3       // In RPM
+#define RPM_KILO        4       // From 65535 RPM, in 100 RPM
+#define RPM_RANGES      5
+
+uint16_t RpmFromPeriod(uint32_t ticks);
+uint8_t RpmRange(uint16_t rpm, uint8_t range);
+uint16_t RpmScaled(uint32_t ticks, uint16_t rpm, uint8_t range);
+uint16_t RpmScaledMilli(uint32_t mrpm, uint8_t range);
+uint32_t RpmWhole(uint16_t reading, uint8_t range);
+
+#endif
@@ -0,0 +1,332 @@
+#include <xc.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "simhooks.h"
+#include "strobe.h"
+#include "pulse.h"
+#include "rpm.h"
+#include "settings.h"
+
+//
+// The settings are saved as a journal of records in the data EEPROM, each
+// written to the slot after the last one so the 100k erase/write cycles of
+// a byte are spread over all of them. Every record has a sequence number
+// and a CRC: at power up all the slots are read, a fixed SETTINGS_SLOTS*32
+// bytes, and the newest one that checks out is the one that counts. A
+// record cut short by the power going is simply older than the one before
+// it, which is still there.
+//
+// Nothing is written until the settings have stayed the same for
+// SETTINGS_SETTLE, so turning the knob through a range is one record and
+// not one per step. The statistics are saved when the motor stops. The
+// writing is done a byte at a time from the main loop, each byte takes
+// about 4ms and the main loop just carries on while it does. The ISR is
+// only held off for the four instructions of the unlock sequence, which
+// has to come in one piece. Bytes that already hold the right value are
+// left alone.
+//
+// There's no copy of the record in RAM. The CRC is worked out from the
+// settings as they are when the record is started and each byte is taken
+// from them as it's written, so a setting changed while that goes on
+// leaves a record that doesn't check out, like one cut short. Whatever
+// changed it has the record written again after it.
+//
+
+#define SLOT_SIZE       32      // sizeof(t_record)
+
+typedef struct {
+    uint32_t frequency;
+    uint16_t seq;               // One more than the record before it
+    uint16_t phase;
+    uint16_t delay;
+    uint16_t width;
+    uint16_t duty;
+    int16_t drift;
+    uint32_t runMin;            // Lowest and highest readings of the last run, RPM
+    uint32_t runMax;
+    uint32_t shortest;          // Fastest single revolution there's been, Timer0 ticks
+    uint8_t flashes;
+    uint8_t spare;              // For a setting to come, keeps it at SLOT_SIZE
+    uint16_t crc;               // Of all the bytes before it
+} t_record;
+
+// The CRC of each top nibble shifted out
+static const uint16_t crcNibble[16]={
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+// Where each pair of bytes of the record starts, the spare goes with flashes
+static const uint8_t fieldAt[SLOT_SIZE/2]={
+    offsetof(t_record, frequency), offsetof(t_record, frequency),
+    offsetof(t_record, seq), offsetof(t_record, phase),
+    offsetof(t_record, delay), offsetof(t_record, width),
+    offsetof(t_record, duty), offsetof(t_record, drift),
+    offsetof(t_record, runMin), offsetof(t_record, runMin),
+    offsetof(t_record, runMax), offsetof(t_record, runMax),
+    offsetof(t_record, shortest), offsetof(t_record, shortest),
+    offsetof(t_record, flashes), offsetof(t_record, crc),
+};
+
+static uint16_t seq=0xFFFF;     // Of the newest record, the first one written is 0
+static uint16_t crc;            // of the one being written
+static uint8_t slot=SETTINGS_SLOTS-1;   // Where it is
+static uint8_t pos=SLOT_SIZE;   // Next byte of it to write
+static uint8_t dirty;
+static uint16_t saves;
+
+static uint16_t last;
+static uint32_t settle;
+
+static uint8_t running;         // There have been readings since the last stop
+static uint32_t runMin;
+static uint32_t runMax;
+static uint32_t lastMin;
+static uint32_t lastMax;
+static uint32_t shortest=0xFFFFFFFFUL;
+
+
+
+//
+// CRC-16-CCITT, 0x1021 starting from 0xFFFF, a nibble at a time
+//
+static uint16_t Crc(uint16_t crc, uint8_t b) {
+    crc^=(uint16_t)b<<8;
+    crc=(crc<<4)^crcNibble[crc>>12];
+    crc=(crc<<4)^crcNibble[crc>>12];
+    SIM_CYCLES(CY_CALL+2*CY_TBLRD+24);
+    return crc;
+}
+
+
+
+static uint8_t Read(uint8_t addr) {
+    EEADR=addr;
+    EECON1bits.EEPGD=0;         // Data EEPROM, not flash
+    EECON1bits.CFGS=0;
+    EECON1bits.RD=1;
+    SIM_CYCLES(CY_CALL);
+    return EEDATA;
+}
+
+
+
+//
+// A field of n bytes from addr on, little endian
+//
+static uint32_t ReadField(uint8_t addr, uint8_t n) {
+    uint32_t v=0;
+
+    while (n--) v=(v<<8)|Read(addr+n);
+    SIM_CYCLES(CY_CALL+8);
+    return v;
+}
+
+
+
+//
+// Byte i of the record to write, from the settings as they are now
+//
+static uint8_t Byte(uint8_t i) {
+    uint32_t v;
+    uint8_t at;
+
+    at=fieldAt[i>>1];
+    switch (at) {
+        case offsetof(t_record, frequency): v=StrobeGetFrequency(); break;
+        case offsetof(t_record, seq): v=seq; break;
+        case offsetof(t_record, phase): v=StrobeGetPhase(); break;
+        case offsetof(t_record, delay): v=StrobeGetDelay(); break;
+        case offsetof(t_record, width): v=PulseGetWidth(); break;
+        case offsetof(t_record, duty): v=PulseGetDuty(); break;
+        case offsetof(t_record, drift): v=(uint16_t)StrobeGetDrift(); break;
+        case offsetof(t_record, runMin): v=lastMin; break;
+        case offsetof(t_record, runMax): v=lastMax; break;
+        case offsetof(t_record, shortest): v=shortest; break;
+        case offsetof(t_record, flashes): v=0xFF00|StrobeGetFlashes(); break;
+        default: v=crc; break;
+    }
+    SIM_CYCLES(2*CY_CALL+CY_TBLRD+24);
+    return (uint8_t)(v>>8*(i-at));
+}
+
+
+
+//
+// Start writing the next byte of the record once the last one is done
+//
+static void WriteNext(void) {
+    uint8_t addr, b;
+
+    if (EECON1bits.WR) return;
+    addr=slot*SLOT_SIZE+pos;
+    b=Byte(pos);
+    pos++;
+    SIM_CYCLES(CY_CALL+12);
+    if (Read(addr)==b) return;
+
+    EEADR=addr;
+    EEDATA=b;
+    EECON1bits.WREN=1;
+    GIE=0;
+    EECON2=0x55;
+    EECON2=0xAA;
+    EECON1bits.WR=1;
+    GIE=1;
+    EECON1bits.WREN=0;          // Doesn't stop the write that has started
+}
+
+
+
+//
+// Find the newest good record and put its settings into effect, before
+// the interrupts are enabled. Without one the defaults stay.
+//
+void SettingsLoad(void) {
+    uint16_t c, n;
+    uint8_t s, i, addr, found=0;
+
+    for (s=0; s<SETTINGS_SLOTS; s++) {
+        addr=s*SLOT_SIZE;
+        c=0xFFFF;
+        for (i=0; i<offsetof(t_record, crc); i++) c=Crc(c, Read(addr+i));
+        SIM_CYCLES(SLOT_SIZE*8);
+        if (c!=(uint16_t)ReadField(addr+offsetof(t_record, crc), 2)) continue;
+        n=(uint16_t)ReadField(addr+offsetof(t_record, seq), 2);
+        if (found && (int16_t)(n-seq)<=0) continue;
+        seq=n;
+        slot=s;
+        found=1;
+    }
+    if (!found) return;
+
+    addr=slot*SLOT_SIZE;
+    StrobeSetPhase((uint16_t)ReadField(addr+offsetof(t_record, phase), 2));
+    StrobeSetDelay((uint16_t)ReadField(addr+offsetof(t_record, delay), 2));
+    StrobeSetFlashes(Read(addr+offsetof(t_record, flashes)));
+    PulseSetWidth((uint16_t)ReadField(addr+offsetof(t_record, width), 2));
+    PulseSetDuty((uint16_t)ReadField(addr+offsetof(t_record, duty), 2));
+    StrobeSetDrift((int16_t)ReadField(addr+offsetof(t_record, drift), 2));
+    StrobeSetFrequency(ReadField(addr+offsetof(t_record, frequency), 4));
+    lastMin=ReadField(addr+offsetof(t_record, runMin), 4);
+    lastMax=ReadField(addr+offsetof(t_record, runMax), 4);
+    shortest=ReadField(addr+offsetof(t_record, shortest), 4);
+}
+
+
+
+//
+// Called from the main loop, saves the settings when they have settled
+// and writes the record out a byte at a time
+//
+void SettingsPoll(void) {
+    uint16_t now;
+    uint8_t i;
+
+    SIM_CYCLES(CY_CALL+4);
+    if (dirty && settle<SETTINGS_SETTLE) {
+        now=TMR0L;
+        now|=(uint16_t)TMR0H<<8;    // Latched when TMR0L was read
+        settle+=(uint16_t)(now-last);
+        last=now;
+        SIM_CYCLES(CY_ADD32+8);
+    }
+    if (pos<SLOT_SIZE) {
+        WriteNext();
+        return;
+    }
+    if (!dirty || settle<SETTINGS_SETTLE) return;
+
+    seq++;
+    crc=0xFFFF;
+    for (i=0; i<offsetof(t_record, crc); i++) crc=Crc(crc, Byte(i));
+    slot=(slot+1)&(SETTINGS_SLOTS-1);
+    pos=0;
+    dirty=0;
+    saves++;
+    SIM_CYCLES(20);
+}
+
+
+
+//
+// There's a record waiting to be saved or being written, SettingsPoll()
+// has to be called until it's done
+//
+uint8_t SettingsBusy(void) {
+    return dirty || pos<SLOT_SIZE;
+}
+
+
+
+//
+// A setting has been changed, save it once it stays that way
+//
+void SettingsChanged(void) {
+    dirty=1;
+    settle=0;
+    last=TMR0L;
+    last|=(uint16_t)TMR0H<<8;   // Latched when TMR0L was read
+}
+
+
+
+//
+// The period of every revolution, the peak is kept as the shortest so it
+// doesn't need a divide for every one
+//
+void SettingsRevolution(uint32_t period) {
+    SIM_CYCLES(CY_CALL+CY_ADD32+4);
+    if (period>=shortest) return;
+    shortest=period;
+    if (pos<SLOT_SIZE) dirty=1;     // Too late for the record being written
+}
+
+
+
+//
+// The RPM shown, for the lowest and highest of the run
+//
+void SettingsReading(uint32_t rpm) {
+    SIM_CYCLES(CY_CALL+2*CY_ADD32+8);
+    if (!rpm) return;
+    if (!running || rpm<runMin) runMin=rpm;
+    if (!running || rpm>runMax) runMax=rpm;
+    running=1;
+}
+
+
+
+//
+// The motor has stopped, the run's statistics are saved right away
+//
+void SettingsStopped(void) {
+    SIM_CYCLES(CY_CALL+12);
+    if (!running) return;
+    lastMin=runMin;
+    lastMax=runMax;
+    running=0;
+    dirty=1;
+    settle=SETTINGS_SETTLE;
+}
+
+
+
+uint32_t SettingsGetMin(void) {
+    return lastMin;
+}
+
+uint32_t SettingsGetMax(void) {
+    return lastMax;
+}
+
+//
+// The fastest revolution in RPM, 0 if there hasn't been one
+//
+uint32_t SettingsGetPeak(void) {
+    return shortest==0xFFFFFFFFUL ? 0 : RPM_CONSTANT/shortest;
+}
+
+uint16_t SettingsGetSaves(void) {
+    return saves;
+}
@@ -0,0 +1,25 @@
+//
+// Settings and RPM statistics kept in the data EEPROM over power cycles
+//
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdint.h>
+
+#define SETTINGS_SLOTS  8       // Records in the journal, SETTINGS_SLOTS*32 bytes of EEPROM
+#define SETTINGS_SETTLE 24000000UL      // Timer0 ticks without a change before saving, 2s
+
+void SettingsLoad(void);
+void SettingsPoll(void);
+uint8_t SettingsBusy(void);
+void SettingsChanged(void);
+void SettingsRevolution(uint32_t period);
+void SettingsReading(uint32_t rpm);
+void SettingsStopped(void);
+uint32_t SettingsGetMin(void);
+uint32_t SettingsGetMax(void);
+uint32_t SettingsGetPeak(void);
+uint16_t SettingsGetSaves(void);
+
+#endif
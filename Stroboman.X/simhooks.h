@@ -0,0 +1,22 @@
+//
+// Hooks for the host simulator in ../Simulator
+//
+// SIM_CYCLES(n) charges n instruction cycles for a block of code that
+// doesn't touch any SFR, SIM_EVENT(e) counts a firmware event and
+// SIM_TRACE(t,v) hands a value to the simulator for checking. The
+// simulator's own <xc.h> defines them, on the real chip they compile
+// to nothing. SIM_USBRAM(a) points at address a of the USB RAM, which
+// the simulator keeps for its model of the USB engine.
+//
+
+#ifndef SIMHOOKS_H
+#define SIMHOOKS_H
+
+#ifndef SIM_CYCLES
+#define SIM_CYCLES(n)
+#define SIM_EVENT(e)
+#define SIM_TRACE(t,v)
+#define SIM_USBRAM(a)   ((volatile uint8_t *)(a))
+#endif
+
+#endif
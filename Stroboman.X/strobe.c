@@ -0,0 +1,399 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "rpm.h"
+#include "strobe.h"
+
+//
+// The flash can be delayed by a fraction of a revolution, so the frozen
+// image can be rotated to any angle and stays put when the speed drifts,
+// plus a fixed time to make up for where the sensor is mounted. The angle
+// is kept as a 16 bit fraction so the ISR only needs a multiply and no
+// divide to turn it into timer ticks.
+//
+// A revolution can hold several evenly spaced flashes, for fans and gears
+// with more than one blade or tooth. The flashes are scheduled as absolute
+// times on the Timer0 timebase from a prediction of the coming revolution:
+// the period just measured plus the smoothed change from one revolution to
+// the next, so the spacing keeps up while the motor speeds up or slows
+// down. Each real edge pulls the schedule back in phase, and if an edge
+// goes missing the schedule coasts on for one more revolution.
+//
+// A flash that would come right around the predicted edge is left for
+// the edge to do. Timer1 firing it would keep the ISR busy just as the
+// edge comes in, and the late timestamp would throw the next prediction
+// off. Timer1 is only set to fire it a little after the edge was due,
+// in case the edge doesn't show up.
+//
+// Without a tach sensor the strobe can run free at a set frequency
+// instead, and the tach edges are only measured. The same schedule then
+// works as a numerically controlled oscillator: each flash adds the
+// interval, kept as 32 bits of Timer0 ticks and a 16 bit fraction, to
+// the 48 bit time of the next one, and Timer1 fires at the whole tick.
+// That's a resolution of a few millionths of a Hz at 1 kHz, and each
+// flash lands within a tick of its time, give or take another interrupt
+// in the way, with no fast interrupt to keep the accumulator going. The
+// drift is added to the frequency so a frozen image can be turned
+// slowly without losing the frequency that froze it.
+//
+
+static uint16_t degrees;
+static uint16_t delayUs;
+static uint8_t flashes=1;
+static volatile uint16_t phase;         // Fraction of a flash interval, 1/65536ths
+static volatile uint16_t reciprocal;    // 65536/flashes, 0 for a single flash
+static volatile uint32_t delayTicks;
+static volatile uint8_t atEdge=1;       // No delay at all
+static uint32_t frequency;              // In mHz, 0 follows the tach
+static int16_t drift;                   // In mHz
+static volatile uint8_t freeRun;        // Flash at the set frequency
+static volatile uint32_t freeStep;      // Ticks between flashes, handed to the ISR with retune
+static volatile uint16_t freeStepFrac;
+static volatile uint8_t retune;
+
+// Only used from the ISR
+static uint32_t lastPeriod;
+static int32_t trend;                   // Predicted change in period per revolution
+static uint8_t primed;
+static uint32_t step;                   // Ticks between flashes, plus 16 bit fraction
+static uint16_t stepFrac;
+static uint32_t target;                 // Time of the next flash, plus 16 bit fraction
+static uint16_t targetFrac;
+static uint32_t lastFlash;
+static uint32_t edgeDue;                // Predicted time of the next edge
+static uint8_t remaining;               // Flashes left before giving up on the edges
+static uint8_t freeRunning;             // Timer1 is going round the free schedule
+
+
+
+//
+// Work out the ISR's copy of the settings. The ISR reads them on the tach
+// edge, keep it from seeing half an update.
+//
+static void Update(void) {
+    uint16_t p, r;
+    uint8_t gie=GIE;
+
+    p=(uint16_t)(((uint32_t)degrees<<16)/360);
+    r=flashes>1 ? (uint16_t)(0x10000UL/flashes) : 0;
+    p*=flashes;             // Only the part within one flash interval
+    SIM_CYCLES(CY_UDIV32+CY_UDIV16+CY_MUL16);
+    GIE=0;
+    phase=p;
+    reciprocal=r;
+    atEdge=!p && !delayTicks;
+    GIE=gie;
+}
+
+
+
+//
+// Set the angle, in degrees after the tach edge, to flash at
+//
+void StrobeSetPhase(uint16_t newDegrees) {
+    while (newDegrees>=360) newDegrees-=360;
+    degrees=newDegrees;
+    Update();
+}
+
+
+
+//
+// Set a fixed delay, in microseconds, added on top of the phase angle
+//
+void StrobeSetDelay(uint16_t us) {
+    uint32_t t;
+    uint8_t gie=GIE;
+
+    delayUs=us;
+    t=(uint32_t)us*STROBE_US;
+    SIM_CYCLES(CY_MUL16);
+    // Any interrupt may find a tach edge pending and schedule from it,
+    // masking INT1 alone wouldn't keep it from a half written delay
+    GIE=0;
+    delayTicks=t;
+    GIE=gie;
+    Update();
+}
+
+
+
+//
+// Set the number of evenly spaced flashes per revolution
+//
+void StrobeSetFlashes(uint8_t n) {
+    if (n<1) n=1;
+    if (n>STROBE_MAXFLASHES) n=STROBE_MAXFLASHES;
+    flashes=n;
+    Update();
+}
+
+
+
+//
+// Work out the interval for the frequency plus the drift and hand it to
+// the ISR, which picks it up at the next flash. TACH_CLOCK*1000 doesn't
+// fit in 32 bits but TACH_CLOCK*125 does, the last three bits and the
+// fraction come from carrying on the long division a bit at a time.
+//
+static void Retune(void) {
+    int32_t f;
+    uint32_t q, r;
+    uint16_t frac=0;
+    uint8_t i, bit;
+
+    if (!frequency) {
+        freeRun=0;
+        return;
+    }
+    f=(int32_t)frequency+drift;
+    if (f<(int32_t)STROBE_MINMHZ) f=STROBE_MINMHZ;
+    if (f>(int32_t)STROBE_MAXMHZ) f=STROBE_MAXMHZ;
+    q=TACH_CLOCK*125/(uint32_t)f;
+    r=TACH_CLOCK*125%(uint32_t)f;
+    SIM_CYCLES(2*CY_UDIV32+4*CY_ADD32);
+    for (i=0; i<19; i++) {
+        r<<=1;
+        bit=r>=(uint32_t)f;
+        if (bit) r-=(uint32_t)f;
+        if (i<3) q=(q<<1)|bit;
+        else frac=(frac<<1)|bit;
+        SIM_CYCLES(2*CY_SHIFT32+CY_ADD32+8);
+    }
+
+    // The ISR only takes it while retune is set, and it isn't while the
+    // new one is being written
+    retune=0;
+    freeStep=q;
+    freeStepFrac=frac;
+    retune=1;
+    freeRun=1;
+}
+
+
+
+//
+// Flash at a fixed frequency, in mHz, rather than following the tach,
+// 0 goes back to the tach
+//
+void StrobeSetFrequency(uint32_t mHz) {
+    if (mHz && mHz<STROBE_MINMHZ) mHz=STROBE_MINMHZ;
+    if (mHz>STROBE_MAXMHZ) mHz=STROBE_MAXMHZ;
+    frequency=mHz;
+    Retune();
+}
+
+
+
+//
+// Set the free running frequency off by a few mHz to turn the image
+//
+void StrobeSetDrift(int16_t mHz) {
+    drift=mHz;
+    Retune();
+}
+
+
+
+uint16_t StrobeGetPhase(void) {
+    return degrees;
+}
+
+uint16_t StrobeGetDelay(void) {
+    return delayUs;
+}
+
+uint8_t StrobeGetFlashes(void) {
+    return flashes;
+}
+
+uint32_t StrobeGetFrequency(void) {
+    return frequency;
+}
+
+int16_t StrobeGetDrift(void) {
+    return drift;
+}
+
+//
+// Timer0 ticks between the free running flashes, 0 when following the
+// tach
+//
+uint32_t StrobeGetInterval(void) {
+    return frequency ? freeStep : 0;
+}
+
+
+
+//
+// Called from the ISR on the edge that starts a revolution, before
+// StrobeEdge(). True when the LED should fire right away, the caller
+// does that before anything else to keep the latency down.
+//
+uint8_t StrobeAtEdge(uint32_t stamp) {
+    SIM_CYCLES(CY_CALL+CY_ADD32+8);
+    if (freeRunning) return 0;
+    if (remaining) {
+        // A flash that is due about now, or was left for this edge
+        if ((int32_t)(target-stamp)>STROBE_LATENCY) return 0;
+        StrobeFired();
+        return 1;
+    }
+    if (!atEdge) return 0;
+    // The coasting schedule may have flashed for this edge already
+    stamp-=STROBE_STAMPED;
+    SIM_CYCLES(2*CY_ADD32+8);
+    if ((int32_t)(stamp-lastFlash)<(int32_t)(step>>1)) return 0;
+    lastFlash=stamp;
+    return 1;
+}
+
+
+
+//
+// Move the schedule on by one flash interval
+//
+static void Advance(void) {
+    uint16_t f;
+
+    f=targetFrac+stepFrac;
+    target+=step;
+    if (f<targetFrac) target++;
+    targetFrac=f;
+    SIM_CYCLES(CY_CALL+CY_ADD32+8);
+}
+
+
+
+//
+// Called from the ISR with the timestamp of the edge that starts a
+// revolution and the period of the one that just ended. Sets up the
+// flashes for the coming revolution, returns 0 when running free and
+// there are none to set up.
+//
+uint8_t StrobeEdge(uint32_t stamp, uint32_t period) {
+    uint32_t p, t, offset;
+    int32_t limit;
+
+    SIM_CYCLES(2);
+    if (freeRun) {
+        primed=0;           // Start the trend over when back on the tach
+        return 0;
+    }
+    freeRunning=0;
+
+    // Predict the coming revolution from the last one and the trend
+    if (primed) trend+=((int32_t)(period-lastPeriod)-trend)>>STROBE_TRENDLOG2;
+    primed=1;
+    lastPeriod=period;
+    // A glitch shouldn't make it go wild, the period won't change by more
+    // than an eighth from one revolution to the next
+    limit=(int32_t)(period>>3);
+    if (trend>limit) trend=limit;
+    if (trend<-limit) trend=-limit;
+    p=period+trend;
+    edgeDue=stamp-STROBE_STAMPED+p;
+    SIM_CYCLES(CY_CALL+9*CY_ADD32+2*CY_SHIFT32+12);
+
+    // Split it up in flash intervals, p*reciprocal/65536 with the fraction
+    // kept so the flashes don't drift over the revolution
+    if (!reciprocal) {
+        step=p;
+        stepFrac=0;
+    } else {
+        t=(uint32_t)(uint16_t)p*reciprocal;
+        step=(uint32_t)(uint16_t)(p>>16)*reciprocal+(t>>16);
+        stepFrac=(uint16_t)t;
+        SIM_CYCLES(2*CY_MUL16+CY_ADD32);
+    }
+
+    // The first flash goes the phase angle into the interval, plus the
+    // fixed delay, counted from the real edge rather than when the ISR got
+    // round to stamping it
+    offset=(uint32_t)(uint16_t)(step>>16)*phase;
+    offset+=((uint32_t)(uint16_t)step*phase)>>16;
+    offset+=delayTicks;
+    SIM_CYCLES(2*CY_MUL16+2*CY_ADD32+8);
+    if (offset>=step) {
+        offset%=step;
+        SIM_CYCLES(CY_UDIV32);
+    }
+    target=stamp-STROBE_STAMPED+offset;
+    targetFrac=0;
+    SIM_CYCLES(CY_ADD32+4);
+
+    // Don't flash twice for the same spot if the coasting schedule, or
+    // StrobeAtEdge(), has just been there
+    SIM_CYCLES(CY_ADD32+8);
+    if ((int32_t)(target-lastFlash)<(int32_t)(step>>1)) Advance();
+
+    // This revolution, and one more should the next edge go missing
+    remaining=flashes*2;
+    return 1;
+}
+
+
+
+//
+// Called from the ISR while Timer1 is idle. Starts the free running
+// schedule from now and returns 1 if the strobe has just been set to run
+// free.
+//
+uint8_t StrobeFreeStart(uint32_t now) {
+    SIM_CYCLES(CY_CALL+4);
+    if (!freeRun || !retune) return 0;
+    step=freeStep;
+    stepFrac=freeStepFrac;
+    retune=0;
+    target=now+step;
+    targetFrac=0;
+    remaining=0;
+    freeRunning=1;
+    SIM_CYCLES(CY_ADD32+20);
+    return 1;
+}
+
+
+
+//
+// The time on the Timer0 timebase the next flash is due. One that is
+// close to the predicted edge is put off until just after it instead.
+//
+uint32_t StrobeTarget(void) {
+    SIM_CYCLES(CY_CALL+2*CY_ADD32+12);
+    if (freeRunning) return target;
+    if ((uint32_t)(target-edgeDue+STROBE_GUARD)<=STROBE_GUARD+STROBE_LATENCY) {
+        return edgeDue+STROBE_GUARD;
+    }
+    return target;
+}
+
+
+
+//
+// Called from the ISR when the flash at StrobeTarget() has been done, or
+// is given up on. Returns 0 when there is nothing more to schedule until
+// the next tach edge.
+//
+uint8_t StrobeFired(void) {
+    SIM_CYCLES(CY_CALL+10);
+    if (freeRunning) {
+        if (!freeRun) {
+            freeRunning=0;
+            return 0;
+        }
+        // A new frequency carries on from this flash
+        if (retune) {
+            step=freeStep;
+            stepFrac=freeStepFrac;
+            retune=0;
+            SIM_CYCLES(12);
+        }
+        Advance();
+        return 1;
+    }
+    lastFlash=target;
+    Advance();
+    if (remaining) remaining--;
+    return remaining;
+}
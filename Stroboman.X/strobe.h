@@ -0,0 +1,36 @@
+//
+// When to fire the LED relative to the tach edge
+//
+
+#ifndef STROBE_H
+#define STROBE_H
+
+#include <stdint.h>
+
+#define STROBE_US           12      // Timer ticks per microsecond
+#define STROBE_LATENCY      93      // Ticks from reading Timer0 to the LED on, via Timer1
+#define STROBE_STAMPED      26      // Ticks from the tach edge to the ISR reading Timer0
+#define STROBE_GUARD        480     // Ticks before the predicted edge left for the edge to flash
+#define STROBE_MAXFLASHES   32      // Flashes per revolution
+#define STROBE_TRENDLOG2    2       // Smoothing of the period trend, 1/4 per revolution
+#define STROBE_MINMHZ       1000UL  // Free running flash rate range, in mHz
+#define STROBE_MAXMHZ       1000000UL
+
+void StrobeSetPhase(uint16_t degrees);
+void StrobeSetDelay(uint16_t us);
+void StrobeSetFlashes(uint8_t flashes);
+uint16_t StrobeGetPhase(void);
+uint16_t StrobeGetDelay(void);
+void StrobeSetFrequency(uint32_t mHz);
+void StrobeSetDrift(int16_t mHz);
+uint8_t StrobeGetFlashes(void);
+uint32_t StrobeGetFrequency(void);
+int16_t StrobeGetDrift(void);
+uint32_t StrobeGetInterval(void);
+uint8_t StrobeAtEdge(uint32_t stamp);
+uint8_t StrobeEdge(uint32_t stamp, uint32_t period);
+uint8_t StrobeFreeStart(uint32_t now);
+uint32_t StrobeTarget(void);
+uint8_t StrobeFired(void);
+
+#endif
@@ -0,0 +1,271 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "usb.h"
+#include "tach.h"
+
+//
+// Single producer/single consumer ring buffer. Only the ISR writes head
+// and only the main loop writes tail, both are single bytes so they are
+// updated atomically and no interrupt locking is needed. A sample is
+// written completely before head is advanced past it. When the main loop
+// falls too far behind the newest samples are dropped and counted. The
+// ring is kept at the top of the USB RAM, see usb.h.
+//
+// The ISR also checks the tach line for noise here. A bounce or a spike
+// shortly after an edge is blanked out, and a revolution that is far off
+// what the last two make out is left out rather than averaged into the
+// reading or used to time the flashes, which keep to the schedule of the
+// one before. The first revolution after a start or a stall sets the
+// estimate, and so does one that comes after TACH_GATEMISSES were left
+// out, so a real change of speed gets through. A single lost edge is made
+// up for and the edges kept in step. After a revolution was left out they
+// may be a half out of step all the same, so the flash on the edge waits
+// for one to be taken. Only the blanking goes before that flash, a flag
+// and a compare, and the rest of the checks after it. An edge that ends a
+// revolution far off has had its flash by then, and one that makes up for
+// a lost edge is left to the schedule to flash for.
+//
+
+#define RING            ((volatile t_tachSample *)SIM_USBRAM(USB_TACH))
+
+static volatile uint8_t head;
+static volatile uint8_t tail;
+static volatile uint16_t overruns;
+
+static uint8_t blankLog2=TACH_BLANKLOG2;
+static uint8_t gateLog2=TACH_GATELOG2;
+static uint32_t blank=TACH_MINBLANK;    // Ticks after an edge the next one isn't counted
+static uint32_t blankUntil;
+static uint8_t primed;          // blankUntil is set, not before the first edge after a restart
+static uint32_t start;          // Of the revolution going on
+static uint32_t halfAt;         // and its edge halfway
+static uint32_t last;           // The last revolution taken, 0 if the one before wasn't
+static uint32_t estimate;       // The next one from that, 0 before there is one
+static uint32_t low;            // and less and more the margin of the gate
+static uint32_t high;
+static uint32_t earliest;       // The next revolution is plausible if it ends between
+static uint32_t latest;         // these
+static uint8_t misses;          // Revolutions left out in a row
+static uint8_t half;            // The next edge is halfway round
+static uint8_t slipped;         // The last revolution had lost an edge
+static volatile uint16_t blanked;
+static volatile uint16_t rejected;
+
+
+
+//
+// Called from the ISR for every completed revolution, and with a period
+// of 0 when the motor has stopped
+//
+void TachPush(uint32_t period, uint32_t stamp) {
+    uint8_t h=head;
+
+    SIM_CYCLES(CY_CALL+8);
+    SIM_TRACE(SIM_TR_PERIOD, period);
+    if ((uint8_t)(h-tail)>=TACH_RINGSIZE) {
+        overruns++;
+        SIM_EVENT(SIM_EV_OVERRUN);
+        return;
+    }
+    RING[h&(TACH_RINGSIZE-1)].period=period;
+    RING[h&(TACH_RINGSIZE-1)].stamp=stamp;
+    head=h+1;
+    SIM_CYCLES(20);
+}
+
+
+
+//
+// Fetch the oldest sample, returns 0 if the ring is empty
+//
+uint8_t TachPop(t_tachSample *sample) {
+    uint8_t t=tail;
+
+    SIM_CYCLES(CY_CALL+6);
+    if (t==head) return 0;
+    sample->period=RING[t&(TACH_RINGSIZE-1)].period;
+    sample->stamp=RING[t&(TACH_RINGSIZE-1)].stamp;
+    tail=t+1;
+    SIM_CYCLES(24);
+    return 1;
+}
+
+
+
+//
+// Number of samples dropped because the ring was full
+//
+uint16_t TachOverruns(void) {
+    uint16_t n;
+
+    // Read until two reads agree in case the ISR updated it halfway
+    do {
+        n=overruns;
+    } while (n!=overruns);
+    return n;
+}
+
+
+
+//
+// Called from the ISR first thing for every edge, before the flash that
+// may go on it. Returns TACH_NOISE for one that is blanked out, TACH_END
+// for one that ends a revolution in step with the last one taken and
+// TACH_HALF for any other, TachEdge() has the last word on what it is.
+//
+uint8_t TachBlank(uint32_t stamp) {
+    SIM_CYCLES(CY_CALL+CY_ADD32+6);
+    if (primed && (int32_t)(stamp-blankUntil)<0) {
+        blanked++;
+        return TACH_NOISE;
+    }
+    SIM_CYCLES(4);
+    return half && !misses ? TACH_END : TACH_HALF;
+}
+
+
+
+//
+// Called from the ISR for every edge that wasn't blanked out, after the
+// flash, what it is. The revolution is only checked once there's been
+// one taken to go by. If one edge went missing the next is a half out of
+// step: a half that ends where the revolution should is taken as the end,
+// and a late end that comes a revolution after the half, which a motor
+// slowing down doesn't do, as the half of the next revolution. That
+// starts where the lost edge should have been. Not for two revolutions
+// running though, or a wrong estimate would hold the edges to it.
+//
+uint8_t TachEdge(uint32_t stamp) {
+    SIM_CYCLES(CY_CALL+4);
+    if (!half) {
+        // On the end TachRevolution() sets the blanking, after the flash
+        blankUntil=stamp+blank;
+        primed=1;
+        half=1;
+        SIM_CYCLES(CY_ADD32);
+        if (!estimate || misses || slipped || (int32_t)(stamp-earliest)<0) {
+            slipped=0;
+            halfAt=stamp;
+            return TACH_HALF;
+        }
+        slipped=1;
+        SIM_CYCLES(CY_ADD32+4);
+    }
+    half=0;
+    if (!estimate || misses>=TACH_GATEMISSES) return misses ? TACH_RESYNC : TACH_END;
+    SIM_CYCLES(2*CY_ADD32+4);
+    if ((int32_t)(stamp-earliest)>=0 && (int32_t)(stamp-latest)<=0) {
+        return misses ? TACH_RESYNC : TACH_END;
+    }
+    if (!misses && !slipped && (int32_t)(stamp-latest)>0
+            && (int32_t)(stamp-halfAt-low)>=0 && (int32_t)(stamp-halfAt-high)<=0) {
+        half=1;
+        slipped=1;
+        start+=estimate;
+        earliest+=estimate;
+        latest+=estimate;
+        SIM_CYCLES(5*CY_ADD32+8);
+        return TACH_HALF;
+    }
+    misses++;
+    rejected++;
+    return TACH_LEFTOUT;
+}
+
+
+
+//
+// Called from the ISR on the edge that ends a revolution, with whether
+// it's to be taken, to set up the checks for the next one. Returns the
+// period, from where the revolution started.
+//
+uint32_t TachRevolution(uint32_t stamp, uint8_t taken) {
+    uint32_t period, margin;
+    int32_t change;
+    uint8_t i;
+
+    period=stamp-start;
+    start=stamp;
+    SIM_CYCLES(CY_CALL+CY_ADD32+4);
+    if (taken) {
+        misses=0;
+        margin=period;
+        for (i=gateLog2; i; i--) margin>>=1;
+        // The next one changes by as much as this one did, up to the margin,
+        // when the two were taken running
+        change=last ? (int32_t)(period-last) : 0;
+        if (change>(int32_t)margin) change=(int32_t)margin;
+        if (change<-(int32_t)margin) change=-(int32_t)margin;
+        last=period;
+        // Nothing to go by with the gate off
+        estimate=gateLog2 ? period+change : 0;
+        low=estimate-margin;
+        high=estimate+margin;
+        blank=period;
+        for (i=blankLog2; i; i--) blank>>=1;
+        if (!blankLog2) blank=0;
+        else if (blank<TACH_MINBLANK) blank=TACH_MINBLANK;
+        SIM_CYCLES((gateLog2+blankLog2)*CY_SHIFT32+7*CY_ADD32+20);
+    } else {
+        last=0;
+    }
+    blankUntil=stamp+blank;
+    primed=1;
+    earliest=stamp+low;
+    latest=stamp+high;
+    SIM_CYCLES(3*CY_ADD32);
+    return period;
+}
+
+
+
+//
+// Called from the ISR when the motor has stopped, and with the interrupts
+// off before the chip goes to sleep, the next revolution starts afresh.
+// Nothing is blanked before its first edge, however long the stop has
+// been.
+//
+void TachRestart(void) {
+    primed=0;
+    estimate=0;
+    last=0;
+    misses=0;
+    blank=blankLog2 ? TACH_MINBLANK : 0;
+    SIM_CYCLES(CY_CALL+16);
+}
+
+
+
+//
+// Set the blanking and the gate, 1/2^log2 of a revolution, 0 for off.
+// They take over from the next revolution.
+//
+void TachSetFilter(uint8_t blanking, uint8_t gating) {
+    blankLog2=blanking;
+    gateLog2=gating;
+    if (!blanking) blank=0;
+}
+
+
+
+//
+// Number of edges blanked out and of revolutions left out
+//
+uint16_t TachBlanked(void) {
+    uint16_t n;
+
+    do {
+        n=blanked;
+    } while (n!=blanked);
+    return n;
+}
+
+uint16_t TachRejected(void) {
+    uint16_t n;
+
+    do {
+        n=rejected;
+    } while (n!=rejected);
+    return n;
+}
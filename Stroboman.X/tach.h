@@ -0,0 +1,53 @@
+//
+// Tach measurements handed from the ISR to the main loop
+//
+
+#ifndef TACH_H
+#define TACH_H
+
+#include <stdint.h>
+
+#define TACH_RINGSIZE   8       // Must be a power of two
+
+// The motor has stopped when there's been no revolution for 2^TACH_STALLLOG2
+// times the last one took, but not before TACH_MINSTALL, and always after
+// TACH_MAXPERIOD. Timer0 ticks, the slowest is 30s a revolution or 2 RPM.
+#define TACH_STALLLOG2  2
+#define TACH_MINSTALL   3000000UL
+#define TACH_MAXPERIOD  360000000UL
+
+// Noise on the tach line. An edge within 1/2^TACH_BLANKLOG2 of the last
+// revolution after the edge before, and never under TACH_MINBLANK, isn't
+// counted. A revolution more than 1/2^TACH_GATELOG2 of one off what the
+// last two taken make out is left out, unless TACH_GATEMISSES in a row
+// have been. 0 for either log2 turns it off. There are two edges to a
+// revolution.
+#define TACH_BLANKLOG2  3
+#define TACH_MINBLANK   1200UL  // 100us, a fifth of half a revolution at RPM_MAX
+#define TACH_GATELOG2   2
+#define TACH_GATEMISSES 2
+
+// What TachBlank() and TachEdge() make of an edge
+#define TACH_NOISE      0       // Blanked out
+#define TACH_HALF       1       // Halfway round
+#define TACH_END        2       // Ends a revolution
+#define TACH_RESYNC     3       // Ends one after one was left out, the edges may have slipped
+#define TACH_LEFTOUT    4       // Ends one far off the last, to be left out
+
+typedef struct {
+    uint32_t period;            // Timer0 ticks for the last revolution, 0 when it stopped
+    uint32_t stamp;             // Timer0 tick at the end of the revolution
+} t_tachSample;
+
+void TachPush(uint32_t period, uint32_t stamp);
+uint8_t TachPop(t_tachSample *sample);
+uint16_t TachOverruns(void);
+uint8_t TachBlank(uint32_t stamp);
+uint8_t TachEdge(uint32_t stamp);
+uint32_t TachRevolution(uint32_t stamp, uint8_t taken);
+void TachRestart(void);
+void TachSetFilter(uint8_t blanking, uint8_t gating);
+uint16_t TachBlanked(void);
+uint16_t TachRejected(void);
+
+#endif
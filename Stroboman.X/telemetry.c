@@ -0,0 +1,243 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "usb.h"
+#include "telemetry.h"
+
+//
+// The raw period of every revolution goes out with the reading it made,
+// and so does the time of every flash, so a run-up or a wavering speed can
+// be logged on the host at the full rate instead of what the LCD shows a
+// few times a second. The records queue up in a ring in the free end of
+// the USB RAM and go out in one bulk packet per USB frame, as many whole
+// ones as fit.
+//
+// A packet is a sequence number, the number of records dropped since the
+// last packet and then the records, COBS encoded and ended by a 0. The
+// host can pick up the start of a packet anywhere in the byte stream of
+// the serial port, and a packet lost on the way shows as a gap in the
+// sequence numbers. See ../Telemetry for the decoder.
+//
+// The periods follow on from each other, only a TIME record says when the
+// first of them started. Another one is sent after a stop and whenever
+// periods have been dropped, so the host's clock keeps to the tach's.
+//
+// The ISR queues the flash times in a ring of their own like tach.c's,
+// just ahead of the records, and only while telemetryOn is set, so with
+// no one listening a flash costs no more than testing it. The main loop
+// moves them on into the record ring.
+//
+
+#define FLASHES         ((volatile uint32_t *)SIM_USBRAM(USB_FREE))
+#define RING            ((volatile uint8_t *)SIM_USBRAM(USB_FREE+4*TELEMETRY_FLASHES))
+#define PAYLOAD         (USB_PACKET-2)  // COBS adds a byte and the 0 at the end another
+#define TIME_SIZE       5       // Of a TIME, FLASH or STOP record
+#define PERIOD_SIZE     8
+
+volatile uint8_t telemetryOn;
+
+static volatile uint8_t flashHead;
+static volatile uint8_t flashTail;
+static volatile uint8_t flashLost;      // Flashes the ISR had no room for
+static uint8_t flashLostSeen;
+
+static uint8_t head;            // Of the record ring, all in the main loop
+static uint8_t tail;
+static uint16_t dropped;
+static uint8_t unreported;      // Records dropped since the last packet, stops at 255
+
+static uint8_t synced;          // The host knows when the next period starts
+static uint32_t next;           // and it's then
+static uint8_t seq;
+static uint8_t frame;           // The last packet went in this USB frame
+
+static volatile uint8_t *out;   // COBS encoder
+static uint8_t outLen;
+static uint8_t outCode;         // Where the byte that says how far to the next 0 goes
+static uint8_t outRun;
+
+
+
+static uint8_t Room(uint8_t n) {
+    SIM_CYCLES(CY_CALL+6);
+    return (uint8_t)(TELEMETRY_BUFSIZE-(uint8_t)(head-tail))>=n;
+}
+
+
+
+static void Drop(void) {
+    dropped++;
+    if (unreported!=0xFF) unreported++;
+    SIM_CYCLES(CY_CALL+8);
+}
+
+
+
+static void Put(uint8_t b) {
+    RING[head&(TELEMETRY_BUFSIZE-1)]=b;
+    head++;
+    SIM_CYCLES(CY_CALL+6);
+}
+
+
+
+static void PutTime(uint8_t type, uint32_t t) {
+    Put(type);
+    Put((uint8_t)t);
+    Put((uint8_t)(t>>8));
+    Put((uint8_t)(t>>16));
+    Put((uint8_t)(t>>24));
+    SIM_CYCLES(CY_CALL+12);
+}
+
+
+
+//
+// COBS, each 0 is replaced by how far it is to the next one. A packet is
+// never long enough to need the code for a run of 254 without a 0.
+//
+static void Encode(uint8_t b) {
+    SIM_CYCLES(CY_CALL+10);
+    if (b) {
+        out[outLen++]=b;
+        outRun++;
+        return;
+    }
+    out[outCode]=outRun;
+    outCode=outLen++;
+    outRun=1;
+}
+
+
+
+//
+// Called from the ISR for each flash, with the time it was aimed at
+//
+void TelemetryFlash(uint32_t at) {
+    uint8_t h=flashHead;
+
+    SIM_CYCLES(CY_CALL+8);
+    if ((uint8_t)(h-flashTail)>=TELEMETRY_FLASHES) {
+        flashLost++;
+        return;
+    }
+    FLASHES[h&(TELEMETRY_FLASHES-1)]=at;
+    flashHead=h+1;
+    SIM_CYCLES(16);
+}
+
+
+
+//
+// A revolution, with the reading the main loop made of it
+//
+void TelemetryPeriod(uint32_t period, uint32_t stamp, uint16_t reading, uint8_t range) {
+    uint32_t start;
+
+    SIM_CYCLES(CY_CALL+4);
+    if (!telemetryOn) return;
+    start=stamp-period;
+    SIM_CYCLES(2*CY_ADD32+8);
+    if (!synced || start!=next) {
+        if (!Room(TIME_SIZE+PERIOD_SIZE)) {
+            Drop();
+            return;
+        }
+        PutTime(TELEMETRY_TIME, start);
+    } else if (!Room(PERIOD_SIZE)) {
+        Drop();
+        return;
+    }
+    PutTime(TELEMETRY_PERIOD, period);
+    Put((uint8_t)reading);
+    Put((uint8_t)(reading>>8));
+    Put(range);
+    next=stamp;
+    synced=1;
+}
+
+
+
+//
+// The motor has stopped, the next period starts afresh
+//
+void TelemetryStop(uint32_t stamp) {
+    SIM_CYCLES(CY_CALL+4);
+    if (!telemetryOn) return;
+    synced=0;
+    if (!Room(TIME_SIZE)) {
+        Drop();
+        return;
+    }
+    PutTime(TELEMETRY_STOP, stamp);
+}
+
+
+
+//
+// Called from the main loop, starts and stops with the host opening and
+// closing the port, and sends a packet when the last one has gone and a
+// new USB frame has begun
+//
+void TelemetryPoll(void) {
+    uint8_t on, n, len;
+
+    on=UsbReady();
+    SIM_CYCLES(CY_CALL+6);
+    if (on!=telemetryOn) {
+        // Nothing from before goes out, the ISR's ring is emptied before
+        // it can add to it again
+        flashTail=flashHead;
+        flashLostSeen=flashLost;
+        tail=head;
+        unreported=0;
+        synced=0;
+        telemetryOn=on;
+        SIM_CYCLES(16);
+    }
+    if (!on) return;
+
+    while (flashTail!=flashHead && Room(TIME_SIZE)) {
+        PutTime(TELEMETRY_FLASH, FLASHES[flashTail&(TELEMETRY_FLASHES-1)]);
+        flashTail++;
+        SIM_CYCLES(CY_ADD32+12);
+    }
+    n=flashLost-flashLostSeen;
+    flashLostSeen+=n;
+    while (n--) Drop();
+    SIM_CYCLES(8);
+
+    if (head==tail && !unreported) return;
+    if (UsbFrame()==frame) return;
+    if (!(out=UsbTxBuffer())) return;
+    frame=UsbFrame();
+
+    outCode=0;
+    outLen=1;
+    outRun=1;
+    Encode(seq);
+    Encode(unreported);
+    n=2;
+    while (head!=tail) {
+        len=RING[tail&(TELEMETRY_BUFSIZE-1)]==TELEMETRY_PERIOD ? PERIOD_SIZE : TIME_SIZE;
+        SIM_CYCLES(10);
+        if (n+len>PAYLOAD) break;
+        n+=len;
+        while (len--) Encode(RING[tail++&(TELEMETRY_BUFSIZE-1)]);
+    }
+    out[outCode]=outRun;
+    out[outLen++]=0;
+    UsbTxSend(outLen);
+    seq++;
+    unreported=0;
+    SIM_CYCLES(20);
+}
+
+
+
+//
+// Number of records dropped because the ring was full
+//
+uint16_t TelemetryDropped(void) {
+    return dropped;
+}
@@ -0,0 +1,28 @@
+//
+// Tach periods, readings and flash times streamed out over USB
+//
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEMETRY_BUFSIZE 64    // Bytes of records waiting to be sent, a power of two
+#define TELEMETRY_FLASHES 4     // Flash times the ISR can queue, a power of two
+
+// Records, a type byte and then the fields, little endian
+#define TELEMETRY_PERIOD 'P'    // Period u32, reading u16 and its range u8
+#define TELEMETRY_TIME  'T'     // Timebase u32 the next period starts at
+#define TELEMETRY_FLASH 'F'     // Timebase u32 the flash was aimed at
+#define TELEMETRY_STOP  'S'     // Timebase u32 the motor was taken to have stopped at
+
+// Set while someone is listening, the ISR tests it before queueing a flash
+extern volatile uint8_t telemetryOn;
+
+void TelemetryFlash(uint32_t at);
+void TelemetryPeriod(uint32_t period, uint32_t stamp, uint16_t reading, uint8_t range);
+void TelemetryStop(uint32_t stamp);
+void TelemetryPoll(void);
+uint16_t TelemetryDropped(void);
+
+#endif
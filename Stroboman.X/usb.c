@@ -0,0 +1,482 @@
+#include <xc.h>
+#include <stdint.h>
+#include "simhooks.h"
+#include "usb.h"
+
+//
+// A CDC ACM device, which the host takes for a serial port without a
+// driver of its own. Only the bulk IN endpoint carries anything: what
+// comes in on bulk OUT is thrown away, and the line coding is only kept
+// to be handed back. The USB interrupt isn't used. The SIE is polled from
+// the main loop, which comes round far more often than the host wants an
+// answer, so the ISR and the flash timing never see the USB at all.
+//
+// 3ms without a SOF the SIE takes for the host suspending the bus, or the
+// cable being pulled out, which look the same. The SIE is suspended then
+// and the main loop no longer kept awake for it. Activity on the bus
+// resumes it, and wakes the chip up if it has gone to sleep since.
+//
+// The SIE works on buffer descriptors in the USB RAM, each one owned by
+// either the SIE or the firmware at a time. Ping-pong buffering is off so
+// there's one for each direction of endpoints 0 to 2. Endpoint 0 does the
+// control transfers 8 bytes at a time. Endpoint 1 is the interrupt IN the
+// CDC class wants for notifications, it never has anything to send.
+//
+// USB RAM:
+//   0x200  buffer descriptors, EP0 OUT/IN, EP1 OUT/IN, EP2 OUT/IN
+//   0x218  EP0 OUT, 8 bytes
+//   0x220  EP0 IN, 8 bytes
+//   0x228  EP2 OUT, 8 bytes
+//   0x230  EP2 IN, USB_PACKET bytes
+//   0x270  USB_FREE
+//   0x2C0  USB_TACH
+//
+// Wiring: RA0 <-> D+, RA1 <-> D-, VUSB -> 470nF to ground. D+ is pulled
+// up inside the chip for full speed.
+//
+
+// Buffer descriptor status, as the firmware writes it
+#define BD_UOWN         0x80    // The SIE's to send or fill
+#define BD_DTS          0x40    // DATA1
+#define BD_DTSEN        0x08    // The SIE checks the data toggle
+#define BD_BSTALL       0x04
+// and as the SIE leaves it
+#define BD_PID(s)       (((s)>>2)&0x0F)
+#define PID_SETUP       0x0D
+
+#define BD_EP0OUT       0
+#define BD_EP0IN        1
+#define BD_EP2OUT       4
+#define BD_EP2IN        5
+
+#define EP0OUT_BUF      (USB_RAM+0x18)
+#define EP0IN_BUF       (USB_RAM+0x20)
+#define EP2OUT_BUF      (USB_RAM+0x28)
+#define EP2IN_BUF       (USB_RAM+0x30)
+#define EP0_SIZE        8
+
+// UEPn
+#define EP_IN           0x02
+#define EP_OUT          0x04
+#define EP_NOSETUP      0x08
+#define EP_HSHK         0x10
+#define EP_CONTROL      (EP_HSHK|EP_OUT|EP_IN)
+#define EP_BULK         (EP_HSHK|EP_NOSETUP|EP_OUT|EP_IN)
+#define EP_NOTIFY       (EP_HSHK|EP_NOSETUP|EP_IN)
+
+#define UIR_URST        0x01
+#define UIR_ACTV        0x04
+#define UIR_TRN         0x08
+#define UIR_IDLE        0x10
+#define USTAT_DIR       0x04    // IN
+
+// Requests, standard and then the CDC ones
+#define GET_STATUS      0x00
+#define CLEAR_FEATURE   0x01
+#define SET_ADDRESS     0x05
+#define GET_DESCRIPTOR  0x06
+#define GET_CONFIGURATION 0x08
+#define SET_CONFIGURATION 0x09
+#define SET_INTERFACE   0x0B
+#define SET_LINE_CODING 0x20
+#define GET_LINE_CODING 0x21
+#define SET_CONTROL_LINE_STATE 0x22
+
+// Where endpoint 0 is in a control transfer
+#define CTRL_IDLE       0
+#define CTRL_IN         1       // Sending the data stage
+#define CTRL_OUT        2       // Waiting for the data stage
+#define CTRL_STATUS     3       // Sending the status stage
+
+typedef struct {
+    uint8_t stat;
+    uint8_t cnt;
+    uint8_t adrl;
+    uint8_t adrh;
+} t_bd;
+
+typedef struct {
+    uint8_t type;
+    uint8_t request;
+    uint16_t value;
+    uint16_t index;
+    uint16_t length;
+} t_setup;
+
+#define BDT             ((volatile t_bd *)SIM_USBRAM(USB_RAM))
+
+// USB_VID and USB_PID, see usb.h, no strings
+static const uint8_t device[]={
+    18, 1, 0x00, 0x02, 0x02, 0x00, 0x00, EP0_SIZE,
+    (uint8_t)USB_VID, USB_VID>>8, (uint8_t)USB_PID, USB_PID>>8, 0x00, 0x01, 0, 0, 0, 1,
+};
+
+static const uint8_t configuration[]={
+    9, 2, 67, 0, 2, 1, 0, 0x80, 50,     // Bus powered, 100mA
+    // Communication interface, the ACM with its header, call management,
+    // ACM and union functional descriptors and the notification endpoint
+    9, 4, 0, 0, 1, 0x02, 0x02, 0x01, 0,
+    5, 0x24, 0x00, 0x10, 0x01,
+    5, 0x24, 0x01, 0x00, 1,
+    4, 0x24, 0x02, 0x02,
+    5, 0x24, 0x06, 0, 1,
+    7, 5, 0x81, 0x03, 8, 0, 255,
+    // Data interface, bulk OUT and IN on endpoint 2
+    9, 4, 1, 0, 2, 0x0A, 0x00, 0x00, 0,
+    7, 5, 0x02, 0x02, 8, 0, 0,
+    7, 5, 0x82, 0x02, USB_PACKET, 0, 0,
+};
+
+static const uint8_t zeros[2];
+
+static uint8_t ctrl;
+static const uint8_t *send;     // The rest of the IN data stage
+static uint8_t sendLeft;
+static uint8_t sendEmpty;       // It ends on a full packet short of what was asked
+static uint8_t toggle;          // BD_DTS for the next EP0 IN packet
+static uint8_t address;         // Set once SET_ADDRESS has been answered
+static uint8_t configured;
+static uint8_t lineState;       // DTR in bit 0, RTS in bit 1
+static uint8_t lineCoding[7]={ 0x00, 0xC2, 0x01, 0x00, 0, 0, 8 };  // 115200 8N1
+static uint8_t txToggle;
+static uint8_t attached;        // A host has reset the bus, and hasn't gone quiet since
+
+
+
+//
+// Ready for the next SETUP, or the OUT of a control transfer
+//
+static void ArmControl(void) {
+    BDT[BD_EP0OUT].cnt=EP0_SIZE;
+    BDT[BD_EP0OUT].stat=BD_UOWN;
+    SIM_CYCLES(CY_CALL+6);
+}
+
+
+
+//
+// Hand the next packet of the IN data stage to the SIE
+//
+static void SendNext(void) {
+    volatile uint8_t *p=SIM_USBRAM(EP0IN_BUF);
+    uint8_t n, i;
+
+    n=sendLeft<EP0_SIZE ? sendLeft : EP0_SIZE;
+    for (i=0; i<n; i++) p[i]=*send++;
+    sendLeft-=n;
+    if (n<EP0_SIZE) sendEmpty=0;
+    BDT[BD_EP0IN].cnt=n;
+    BDT[BD_EP0IN].stat=BD_UOWN|BD_DTSEN|toggle;
+    toggle^=BD_DTS;
+    SIM_CYCLES(CY_CALL+n*(CY_TBLRD+6)+20);
+}
+
+
+
+static void Reply(const uint8_t *p, uint8_t n, uint16_t length) {
+    if (n>length) n=(uint8_t)length;
+    send=p;
+    sendLeft=n;
+    sendEmpty=n<length && !(n&(EP0_SIZE-1));
+    ctrl=CTRL_IN;
+    SIM_CYCLES(CY_CALL+12);
+    SendNext();
+}
+
+
+
+//
+// The empty IN packet that ends a transfer with no IN data stage
+//
+static void Status(void) {
+    ctrl=CTRL_STATUS;
+    BDT[BD_EP0IN].cnt=0;
+    BDT[BD_EP0IN].stat=BD_UOWN|BD_DTSEN|BD_DTS;
+    SIM_CYCLES(CY_CALL+6);
+}
+
+
+
+static void Stall(void) {
+    ctrl=CTRL_IDLE;
+    BDT[BD_EP0IN].stat=BD_UOWN|BD_BSTALL;
+    SIM_CYCLES(CY_CALL+4);
+}
+
+
+
+static void Configure(uint8_t c) {
+    configured=c;
+    lineState=0;
+    if (!c) {
+        UEP1=0;
+        UEP2=0;
+        return;
+    }
+    UEP1=EP_NOTIFY;
+    UEP2=EP_BULK;
+    BDT[BD_EP2OUT].cnt=8;
+    BDT[BD_EP2OUT].stat=BD_UOWN;
+    BDT[BD_EP2IN].stat=0;
+    txToggle=0;
+    SIM_CYCLES(CY_CALL+12);
+}
+
+
+
+//
+// A SETUP has come in, the SIE won't take any more packets until
+// PKTDIS is cleared
+//
+static void Setup(void) {
+    volatile uint8_t *p=SIM_USBRAM(EP0OUT_BUF);
+    t_setup s;
+    uint8_t i;
+
+    for (i=0; i<sizeof(s); i++) ((uint8_t *)&s)[i]=p[i];
+    // Whatever was left of the last transfer is dropped
+    BDT[BD_EP0IN].stat=0;
+    toggle=BD_DTS;
+    ctrl=CTRL_IDLE;
+    SIM_CYCLES(CY_CALL+sizeof(s)*6+12);
+
+    if ((s.type&0x60)==0x20) {
+        switch (s.request) {
+            case SET_LINE_CODING: ctrl=CTRL_OUT; break;
+            case GET_LINE_CODING: Reply(lineCoding, sizeof(lineCoding), s.length); break;
+            case SET_CONTROL_LINE_STATE: lineState=(uint8_t)s.value; Status(); break;
+            default: Stall(); break;
+        }
+    } else {
+        switch (s.request) {
+            case GET_DESCRIPTOR:
+                if (s.value==0x0100) Reply(device, sizeof(device), s.length);
+                else if (s.value==0x0200) Reply(configuration, sizeof(configuration), s.length);
+                else Stall();
+                break;
+            case SET_ADDRESS: address=s.value&0x7F; Status(); break;
+            case SET_CONFIGURATION: Configure((uint8_t)s.value); Status(); break;
+            case GET_CONFIGURATION: Reply(&configured, 1, s.length); break;
+            case GET_STATUS: Reply(zeros, 2, s.length); break;
+            case CLEAR_FEATURE:
+            case SET_INTERFACE: Status(); break;
+            default: Stall(); break;
+        }
+    }
+    ArmControl();
+    UCONbits.PKTDIS=0;
+}
+
+
+
+//
+// An IN packet of a control transfer has gone
+//
+static void ControlIn(void) {
+    SIM_CYCLES(CY_CALL+6);
+    if (ctrl==CTRL_IN) {
+        if (sendLeft || sendEmpty) SendNext();
+        return;
+    }
+    // The new address only counts once the status stage is done
+    if (ctrl==CTRL_STATUS && address) {
+        UADDR=address;
+        address=0;
+    }
+    ctrl=CTRL_IDLE;
+}
+
+
+
+//
+// An OUT packet of a control transfer has come in, either the data stage
+// or the end of a transfer that sent some
+//
+static void ControlOut(void) {
+    volatile uint8_t *p=SIM_USBRAM(EP0OUT_BUF);
+    uint8_t n, i;
+
+    SIM_CYCLES(CY_CALL+6);
+    if (ctrl==CTRL_OUT) {
+        n=BDT[BD_EP0OUT].cnt;
+        if (n>sizeof(lineCoding)) n=sizeof(lineCoding);
+        for (i=0; i<n; i++) lineCoding[i]=p[i];
+        SIM_CYCLES(n*6);
+        Status();
+    } else {
+        ctrl=CTRL_IDLE;
+    }
+    ArmControl();
+}
+
+
+
+//
+// The host has reset the bus, start again from address 0
+//
+static void Reset(void) {
+    uint8_t i;
+
+    // Empty the SIE's queue of finished transactions
+    for (i=0; i<4; i++) UIRbits.TRNIF=0;
+    UADDR=0;
+    UEP0=EP_CONTROL;
+    UEP1=0;
+    UEP2=0;
+    BDT[BD_EP0OUT].adrl=(uint8_t)EP0OUT_BUF;
+    BDT[BD_EP0OUT].adrh=(uint8_t)(EP0OUT_BUF>>8);
+    BDT[BD_EP0IN].adrl=(uint8_t)EP0IN_BUF;
+    BDT[BD_EP0IN].adrh=(uint8_t)(EP0IN_BUF>>8);
+    BDT[BD_EP2OUT].adrl=(uint8_t)EP2OUT_BUF;
+    BDT[BD_EP2OUT].adrh=(uint8_t)(EP2OUT_BUF>>8);
+    BDT[BD_EP2IN].adrl=(uint8_t)EP2IN_BUF;
+    BDT[BD_EP2IN].adrh=(uint8_t)(EP2IN_BUF>>8);
+    BDT[BD_EP0IN].stat=0;
+    ctrl=CTRL_IDLE;
+    address=0;
+    configured=0;
+    lineState=0;
+    attached=1;
+    SIM_CYCLES(CY_CALL+42);
+    ArmControl();
+    UCONbits.PKTDIS=0;
+    UIRbits.URSTIF=0;
+}
+
+
+
+//
+// Turn on the USB module, it goes on the bus whenever the cable is in
+//
+void UsbSetup(void) {
+    UCON=0;
+    UIE=0;          // Polled
+    UCFG=0x14;      // Full speed with the pull-up inside the chip, no ping-pong
+    UCONbits.USBEN=1;
+}
+
+
+
+//
+// Called from the main loop, deals with the next transaction the SIE has
+// finished
+//
+void UsbPoll(void) {
+    uint8_t u, ustat;
+
+    u=UIR;
+    SIM_CYCLES(CY_CALL+4);
+    if (UCONbits.SUSPND) {
+        if (!(u&UIR_ACTV)) return;
+        // ACTVIF only clears once the SIE's clock is back up
+        UCONbits.SUSPND=0;
+        while (UIRbits.ACTVIF) UIRbits.ACTVIF=0;
+        attached=1;
+        return;
+    }
+    if (u&UIR_URST) {
+        Reset();
+        return;
+    }
+    if (u&UIR_IDLE) {
+        // Only activity from now on resumes it
+        UIRbits.ACTVIF=0;
+        UIRbits.IDLEIF=0;
+        UCONbits.SUSPND=1;
+        attached=0;
+        return;
+    }
+    if (!(u&UIR_TRN)) return;
+    ustat=USTAT;
+    UIRbits.TRNIF=0;            // Brings up the next one in the SIE's queue
+    SIM_CYCLES(12);
+    switch (ustat&~0x83) {
+        case 0:
+            if (BD_PID(BDT[BD_EP0OUT].stat)==PID_SETUP) Setup();
+            else ControlOut();
+            break;
+        case USTAT_DIR:
+            ControlIn();
+            break;
+        case 2<<3:
+            // Nothing is done with what comes in on bulk OUT
+            BDT[BD_EP2OUT].cnt=8;
+            BDT[BD_EP2OUT].stat=BD_UOWN;
+            break;
+    }
+}
+
+
+
+//
+// The host has configured the device and opened the port, and hasn't
+// suspended the bus or gone
+//
+uint8_t UsbReady(void) {
+    return attached && configured && (lineState&1);
+}
+
+
+
+//
+// A host is at the other end of the cable and the bus isn't suspended.
+// The USB interrupt isn't used, so the main loop has to keep polling.
+//
+uint8_t UsbAttached(void) {
+    return attached;
+}
+
+
+
+//
+// Have activity on the bus wake the chip up from sleep, only with the
+// interrupts off: the ISR doesn't deal with it
+//
+void UsbWakeOn(void) {
+    UIE=UIR_ACTV;
+    USBIE=1;
+}
+
+
+
+//
+// The chip has woken up, UsbPoll() resumes the SIE if the bus did it
+//
+void UsbWoken(void) {
+    USBIE=0;
+    UIE=0;
+    USBIF=0;
+}
+
+
+
+//
+// Low byte of the number of the USB frame, one every 1ms
+//
+uint8_t UsbFrame(void) {
+    return UFRML;
+}
+
+
+
+//
+// The bulk IN packet buffer, 0 while the SIE still has the last one or
+// nobody is listening
+//
+volatile uint8_t *UsbTxBuffer(void) {
+    SIM_CYCLES(CY_CALL+6);
+    if (!UsbReady() || (BDT[BD_EP2IN].stat&BD_UOWN)) return 0;
+    return SIM_USBRAM(EP2IN_BUF);
+}
+
+
+
+//
+// Send the n bytes put in the buffer from UsbTxBuffer()
+//
+void UsbTxSend(uint8_t n) {
+    BDT[BD_EP2IN].cnt=n;
+    BDT[BD_EP2IN].stat=BD_UOWN|BD_DTSEN|txToggle;
+    txToggle^=BD_DTS;
+    SIM_CYCLES(CY_CALL+8);
+}
@@ -0,0 +1,34 @@
+//
+// USB CDC serial port, polled from the main loop
+//
+
+#ifndef USB_H
+#define USB_H
+
+#include <stdint.h>
+
+#define USB_PACKET      64      // Largest packet the bulk IN endpoint sends
+
+// Microchip's VID and the PID of their CDC demo, for trying it out on the
+// bench only. A Stroboman that's given away needs a VID/PID of its own.
+#define USB_VID         0x04D8
+#define USB_PID         0x000A
+
+// The USB RAM from 0x200 on, the SIE reads the buffer descriptors and the
+// packets straight out of it. XC8 is told to leave 0x200-0x2FF alone, so
+// the rest of it holds the rings that don't fit in the 512 bytes below.
+#define USB_RAM         0x200
+#define USB_FREE        0x270   // telemetry.c's rings, 16+64 bytes
+#define USB_TACH        0x2C0   // tach.c's, 8 samples of 8 bytes up to 0x2FF
+
+void UsbSetup(void);
+void UsbPoll(void);
+uint8_t UsbReady(void);
+uint8_t UsbAttached(void);
+void UsbWakeOn(void);
+void UsbWoken(void);
+uint8_t UsbFrame(void);
+volatile uint8_t *UsbTxBuffer(void);
+void UsbTxSend(uint8_t n);
+
+#endif
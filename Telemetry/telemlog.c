@@ -0,0 +1,232 @@
+//
+// Decodes the USB telemetry of the Stroboman firmware into a text log.
+//
+// The input is the CDC serial port the Stroboman shows up as, or a file
+// saved from it or from stroboman-sim -U. The stream is a run of COBS
+// encoded packets, each ended by a 0, see ../Stroboman.X/telemetry.c.
+// Every record comes out as a line, the time first in seconds from the
+// first one in the log:
+//
+//   <s> P <period> <rpm> <reading>   a revolution, its period in Timer0
+//                                    ticks, the RPM worked out from that
+//                                    and the reading the firmware made
+//   <s> F                            a flash, at the time it was aimed at
+//   <s> S                            the motor was taken to have stopped
+//
+//   telemlog [-q] [file or port]
+//
+// Without a file it reads stdin. -q leaves out the records and only gives
+// the count of packets and of what was lost on the way, which also goes
+// to stderr at the end of every log.
+//
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "rpm.h"
+#include "telemetry.h"
+
+#define MAXPACKET   256
+
+// Units of a reading in each range, RPM
+static const double rangeUnits[RPM_RANGES]={ 0.001, 0.01, 0.1, 1, 100 };
+
+static int quiet;
+static volatile sig_atomic_t stop;
+
+static struct {
+    int timed;              // A TIME record has said where we are
+    uint64_t now;           // Timer0 ticks, with the wraps of the firmware's 32 bits added
+    uint64_t origin;        // The first time there was
+    int sequenced;
+    uint8_t seq;
+} t;
+
+static struct {
+    unsigned long packets;
+    unsigned long lost;     // Gaps in the sequence numbers
+    unsigned long bad;      // Packets that didn't decode
+    unsigned long dropped;  // Records the firmware had no room for
+    unsigned long untimed;  // Periods before the first TIME
+    unsigned long periods;
+    unsigned long flashes;
+    unsigned long stops;
+} count;
+
+
+
+static void Interrupted(int sig) {
+    (void)sig;
+    stop=1;
+}
+
+
+
+static uint32_t Get32(const uint8_t *p) {
+    return p[0]|(uint32_t)p[1]<<8|(uint32_t)p[2]<<16|(uint32_t)p[3]<<24;
+}
+
+
+
+//
+// The 32 bit timebase near the time we're at, it wraps every 6 minutes
+//
+static uint64_t Near(uint32_t v) {
+    if (!t.timed) {
+        t.timed=1;
+        t.now=t.origin=v;
+    }
+    return t.now+(int64_t)(int32_t)(v-(uint32_t)t.now);
+}
+
+static double Seconds(uint64_t ticks) {
+    return (double)(int64_t)(ticks-t.origin)/TACH_CLOCK;
+}
+
+
+
+static void Packet(const uint8_t *p, int n) {
+    uint64_t at;
+    uint32_t period;
+    uint16_t reading;
+    int len;
+
+    if (n<2) {
+        count.bad++;
+        return;
+    }
+    count.packets++;
+    if (t.sequenced) count.lost+=(uint8_t)(p[0]-t.seq-1);
+    t.sequenced=1;
+    t.seq=p[0];
+    count.dropped+=p[1];
+
+    for (p+=2, n-=2; n>0; p+=len, n-=len) {
+        len=p[0]==TELEMETRY_PERIOD ? 8 : 5;
+        if (n<len) {
+            count.bad++;
+            return;
+        }
+        switch (p[0]) {
+            case TELEMETRY_TIME:
+                t.now=Near(Get32(p+1));
+                break;
+
+            case TELEMETRY_PERIOD:
+                period=Get32(p+1);
+                reading=p[5]|p[6]<<8;
+                if (!t.timed || !period || p[7]>=RPM_RANGES) {
+                    count.untimed++;
+                    break;
+                }
+                t.now+=period;
+                count.periods++;
+                if (!quiet) {
+                    printf("%.6f P %lu %.3f %.3f\n", Seconds(t.now), (unsigned long)period,
+                        (double)RPM_CONSTANT/period, reading*rangeUnits[p[7]]);
+                }
+                break;
+
+            case TELEMETRY_FLASH:
+            case TELEMETRY_STOP:
+                at=Near(Get32(p+1));
+                if (p[0]==TELEMETRY_FLASH) count.flashes++;
+                else count.stops++;
+                if (!quiet) printf("%.6f %c\n", Seconds(at), p[0]);
+                break;
+
+            default:
+                count.bad++;
+                return;
+        }
+    }
+}
+
+
+
+//
+// Undo the COBS encoding of a packet in place, returns its length or -1
+//
+static int Unstuff(uint8_t *p, int n) {
+    int in=0, out=0, code;
+
+    while (in<n) {
+        code=p[in++];
+        if (!code || in+code-1>n) return -1;
+        memmove(p+out, p+in, code-1);
+        in+=code-1;
+        out+=code-1;
+        if (code<0xFF && in<n) p[out++]=0;
+    }
+    return out;
+}
+
+
+
+//
+// A serial port is put in raw mode, anything else is read as it is
+//
+static void Raw(int fd) {
+    struct termios tio;
+
+    if (!isatty(fd) || tcgetattr(fd, &tio)) return;
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+
+
+int main(int argc, char **argv) {
+    uint8_t buf[4096], packet[MAXPACKET];
+    int fd=0, opt, plen=0, overlong=0;
+    ssize_t got;
+
+    while ((opt=getopt(argc, argv, "q"))!=-1) {
+        switch (opt) {
+            case 'q': quiet=1; break;
+            default:
+                fprintf(stderr, "usage: telemlog [-q] [file or port]\n");
+                return 2;
+        }
+    }
+    if (optind<argc-1) {
+        fprintf(stderr, "usage: telemlog [-q] [file or port]\n");
+        return 2;
+    }
+    if (optind==argc-1 && (fd=open(argv[optind], O_RDONLY|O_NOCTTY))<0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    Raw(fd);
+    signal(SIGINT, Interrupted);
+    signal(SIGTERM, Interrupted);
+
+    while (!stop && (got=read(fd, buf, sizeof(buf)))>0) {
+        for (ssize_t i=0; i<got; i++) {
+            if (buf[i]) {
+                if (plen<MAXPACKET) packet[plen++]=buf[i];
+                else overlong=1;
+                continue;
+            }
+            // The first packet may have been joined halfway through
+            if (overlong || (plen=Unstuff(packet, plen))<0) count.bad++;
+            else Packet(packet, plen);
+            plen=0;
+            overlong=0;
+        }
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "telemlog: %lu packets, %lu lost, %lu bad, %lu records dropped by the device\n",
+        count.packets, count.lost, count.bad, count.dropped);
+    fprintf(stderr, "telemlog: %lu revolutions (%lu before the time was known), %lu flashes, %lu stops\n",
+        count.periods, count.untimed, count.flashes, count.stops);
+    return 0;
+}